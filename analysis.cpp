@@ -0,0 +1,79 @@
+#include "analysis.hpp"
+#include "trace.hpp"
+
+void analyse(const game_t &game, analysis_t &out)
+{
+    CHESS_TRACE_SCOPE("analyse");
+    bool any_move = false;
+    for (uint8_t x = 1; x <= 8; x++)
+        for (uint8_t y = 1; y <= 8; y++)
+        {
+            auto &moves = out.moves[x - 1][y - 1];
+            moves.clear();
+            piece_t piece = game.get(x, y);
+            if (!piece || piece.iswhite() != game.white_turn)
+                continue;
+            // the move filter plays moves on the copy through its current piece
+            game_t g = game;
+            g.set_current_piece(piece);
+            moves = piece.available_moves(g, game.white_turn, game.enpassant);
+            any_move = any_move || !moves.empty();
+        }
+    out.white_check = game.in_check(true);
+    out.black_check = game.in_check(false);
+    out.check_mate = !any_move && (game.white_turn ? out.white_check : out.black_check);
+}
+
+analysis_worker::analysis_worker(void (*wake)()) : wake(wake), thread(&analysis_worker::run, this)
+{
+}
+
+analysis_worker::~analysis_worker()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    cv.notify_one();
+    thread.join();
+}
+
+uint64_t analysis_worker::submit(const game_t &game)
+{
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending = game;
+        generation = pending_generation = ++submitted_generation;
+    }
+    cv.notify_one();
+    return generation;
+}
+
+void analysis_worker::run()
+{
+    CHESS_TRACE_THREAD("analysis");
+    while (true)
+    {
+        uint64_t generation;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this]
+                    { return quit || pending_generation; });
+            if (quit)
+                return;
+            working = pending;
+            generation = pending_generation;
+            pending_generation = 0;
+        }
+
+        analysis_t &out = results.back();
+        auto start = std::chrono::steady_clock::now();
+        analyse(working, out);
+        out.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        out.generation = generation;
+        results.publish();
+        if (wake)
+            wake();
+    }
+}
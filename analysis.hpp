@@ -0,0 +1,94 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "chess.hpp"
+
+// Single producer, single consumer triple buffer. The writer fills back() and
+// publishes it, the reader picks up the newest published buffer in acquire().
+// Neither side ever waits for the other.
+template <typename T>
+class snapshot_buffer
+{
+public:
+    // writer side
+    T &back() { return buffers[back_index]; }
+    void publish()
+    {
+        back_index = middle.exchange(back_index | dirty, std::memory_order_acq_rel) & index_mask;
+    }
+
+    // reader side, the returned reference stays valid until the next acquire()
+    const T &acquire()
+    {
+        if (middle.load(std::memory_order_relaxed) & dirty)
+            front_index = middle.exchange(front_index, std::memory_order_acq_rel) & index_mask;
+        return buffers[front_index];
+    }
+
+private:
+    static constexpr uint8_t dirty = 0x4;
+    static constexpr uint8_t index_mask = 0x3;
+    std::array<T, 3> buffers;
+    std::atomic<uint8_t> middle{1};
+    uint8_t back_index = 0;
+    uint8_t front_index = 2;
+};
+
+// Everything the GUI asks the rules about a position
+struct analysis_t
+{
+    // generation of the position this was computed for, 0 means nothing yet
+    uint64_t generation = 0;
+    // legal destinations of the piece on each square, indexed [x - 1][y - 1]
+    std::array<std::array<std::vector<coordinate_t>, 8>, 8> moves;
+    bool white_check = false;
+    bool black_check = false;
+    // the side to move has no legal move and is in check
+    bool check_mate = false;
+    // time the worker spent in the rules for this position
+    std::chrono::microseconds elapsed{0};
+
+    const std::vector<coordinate_t> &moves_from(coordinate_t p) const { return moves[p.x - 1][p.y - 1]; }
+};
+
+// Owns a thread that runs the rules on submitted positions so that the render
+// loop never does. Results come back through a lock free snapshot and `wake`
+// is called from the worker each time one is published (glfwPostEmptyEvent in
+// the GUI).
+class analysis_worker
+{
+public:
+    analysis_worker(void (*wake)() = nullptr);
+    ~analysis_worker();
+    analysis_worker(const analysis_worker &) = delete;
+    analysis_worker &operator=(const analysis_worker &) = delete;
+
+    // queue a position, replacing any that has not been started yet. Returns
+    // the generation its analysis will carry.
+    uint64_t submit(const game_t &game);
+    // newest published analysis. Only call from one thread.
+    const analysis_t &latest() { return results.acquire(); }
+
+private:
+    void run();
+
+    void (*wake)();
+    std::mutex mutex;
+    std::condition_variable cv;
+    game_t pending;
+    game_t working;
+    uint64_t pending_generation = 0;
+    uint64_t submitted_generation = 0;
+    bool quit = false;
+    snapshot_buffer<analysis_t> results;
+    std::thread thread;
+};
+
+// runs the rules for the side to move, reusing the buffers already in `out`
+void analyse(const game_t &game, analysis_t &out);
@@ -0,0 +1,39 @@
+#include <cstring>
+#include <string>
+#include <stb_image.hpp>
+#include "assets.hpp"
+
+const embedded_image_t *find_image(const char *name)
+{
+    for (size_t i = 0; i < embedded_image_count; i++)
+        if (strcmp(embedded_images[i].name, name) == 0)
+            return &embedded_images[i];
+    return nullptr;
+}
+
+const embedded_image_t *piece_image(piece_type type, bool white)
+{
+    static const char *const names[] = {nullptr, "pawn", "rook", "king", "queen", "bishop", "knight"};
+    if (type == piece_type::invalid)
+        return nullptr;
+    return find_image((std::string(white ? "white-" : "black-") + names[int(type)]).c_str());
+}
+
+image_view_t pixels(const embedded_image_t &image)
+{
+    image_view_t view;
+    if (image.width)
+    {
+        view.width = image.width;
+        view.height = image.height;
+        view.pixels = image.data;
+        return view;
+    }
+    auto decoded = stbi_load_from_memory(image.data, int(image.size), &view.width, &view.height, nullptr, 4);
+    if (!decoded)
+        return view;
+    view.storage.assign(decoded, decoded + size_t(view.width) * view.height * 4);
+    view.pixels = view.storage.data();
+    stbi_image_free(decoded);
+    return view;
+}
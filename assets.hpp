@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "chess.hpp"
+
+// An image compiled in by embed-assets (see CMakeLists.txt), named after its
+// file without the extension, e.g. "white-pawn". The bytes are RGBA when the
+// build decoded it (CHESS_DECODED_ASSETS, the default), otherwise the PNG.
+struct embedded_image_t
+{
+    const char *name;
+    // 0 for a PNG, whose size is only known once decoded
+    int width, height;
+    const unsigned char *data;
+    size_t size;
+};
+
+// defined in the generated images.cpp
+extern const embedded_image_t embedded_images[];
+extern const size_t embedded_image_count;
+
+// RGBA pixels of an embedded image. pixels points into the program for a
+// decoded image and into storage for a PNG, null if it did not decode.
+struct image_view_t
+{
+    int width = 0, height = 0;
+    const uint8_t *pixels = nullptr;
+    std::vector<uint8_t> storage;
+};
+
+// null if there is no such image
+const embedded_image_t *find_image(const char *name);
+const embedded_image_t *piece_image(piece_type type, bool white);
+image_view_t pixels(const embedded_image_t &image);
@@ -0,0 +1,43 @@
+#include "bench.hpp"
+
+const std::array<const char *, 16> bench_positions = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "rnbqkb1r/pp1p1ppp/4pn2/2p5/2PP4/2N5/PP2PPPP/R1BQKBNR w KQkq c6 0 4",
+    "r1bq1rk1/pp2bppp/2n1pn2/3p4/2PP4/2N1PN2/PP1QBPPP/R3KB1R w KQ - 2 9",
+    "2r2rk1/pp1bqpp1/2n1p2p/3pP3/3P4/P1PB1N2/5PPP/R2Q1RK1 w - - 0 17",
+    "r2q1rk1/1b1nbppp/p2ppn2/1p6/3NP3/1BN1BP2/PPPQ2PP/2KR3R b - - 1 11",
+    "4rrk1/pp3ppp/2p5/2b1qN2/4P3/2P3Q1/PP4PP/R4R1K w - - 0 22",
+    "8/5pk1/6p1/p2R3p/P6P/6P1/2r2PK1/8 b - - 3 41",
+    "8/8/4k3/3p4/3P4/4K3/8/8 w - - 0 1",
+    "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1",
+    "8/P7/8/8/8/8/6kp/4K3 w - - 0 60",
+    "r1b1k2r/ppppqppp/2n2n2/2b1p3/2B1P3/2NP1N2/PPP2PPP/R1BQK2R b KQkq - 0 6",
+};
+
+bench_result_t run_bench(int depth, size_t hash_megabytes, void (*on_position)(size_t index, const search_info_t &info))
+{
+    bench_result_t result;
+    transposition_table tt(hash_megabytes);
+    search_limits_t limits;
+    limits.depth = depth;
+    for (size_t i = 0; i < bench_positions.size(); i++)
+    {
+        game_t game;
+        if (!game_t::from_fen(bench_positions[i], game))
+            continue;
+        tt.clear();
+        // fresh pawn and material caches too, they change nothing but the speed
+        searcher_t searcher(tt);
+        search_info_t info = searcher.search(game, limits);
+        result.nodes += info.nodes;
+        result.elapsed += info.elapsed;
+        if (on_position)
+            on_position(i, info);
+    }
+    return result;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include "search.hpp"
+
+// Positions the benchmarks run over: openings, middlegames with both
+// castlings, en passant and promotions, and endgames. Changing them changes
+// the bench signature.
+extern const std::array<const char *, 16> bench_positions;
+
+constexpr int bench_depth = 5;
+
+struct bench_result_t
+{
+    // the signature, any change to what the search does changes it
+    uint64_t nodes = 0;
+    std::chrono::microseconds elapsed{0};
+
+    uint64_t nps() const { return elapsed.count() ? nodes * 1000000 / elapsed.count() : 0; }
+};
+
+// Searches every bench position to `depth` on this thread, each with a
+// cleared table, so the node count depends on nothing but the code.
+// on_position sees the result of each search.
+bench_result_t run_bench(int depth = bench_depth, size_t hash_megabytes = 16,
+                         void (*on_position)(size_t index, const search_info_t &info) = nullptr);
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include "chess.hpp"
+#include "mapped_file.hpp"
+
+// One 16 byte record of a Polyglot book, stored big endian and sorted by key
+struct book_entry_t
+{
+    uint64_t key = 0;
+    // to file in bits 0-2, to rank 3-5, from file 6-8, from rank 9-11,
+    // promotion 12-14 (1 knight ... 4 queen). Castling is king takes rook.
+    uint16_t move = 0;
+    uint16_t weight = 0;
+    uint32_t learn = 0;
+};
+
+// Polyglot position key, laid out as Polyglot hashes: 12 * 64 piece square
+// keys, 4 castling, 8 en passant files (only when the capture is possible)
+// and one for white to move.
+uint64_t polyglot_key(const game_t &game);
+uint16_t encode_book_move(const game_t &game, move_t move);
+// null if the encoded move does not fit the position
+move_t decode_book_move(const game_t &game, uint16_t move);
+void write_book_entry(const book_entry_t &entry, unsigned char *out);
+
+// Read only view of a Polyglot book. Nothing allocates after opening, so one
+// book can be probed from any number of threads.
+class polyglot_book
+{
+public:
+    polyglot_book() = default;
+    explicit polyglot_book(const char *path);
+
+    // false if the file is missing or is not a whole number of entries
+    bool is_open() const { return file.is_open() && file.length() % 16 == 0; }
+    size_t size() const { return is_open() ? file.length() / 16 : 0; }
+
+    // copies up to `max` entries for the key into out, returns how many there are
+    size_t find(uint64_t key, book_entry_t *out, size_t max) const;
+    // picks among the moves for the position with probability proportional to
+    // their weight. `random` should be uniform over 64 bits. Null if the
+    // position is not in the book.
+    move_t pick(const game_t &game, uint64_t random) const;
+
+private:
+    book_entry_t entry(size_t i) const;
+    // index of the first entry with the key, or size() if there is none
+    size_t lower_bound(uint64_t key) const;
+
+    mapped_file file;
+};
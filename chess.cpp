@@ -1,4 +1,5 @@
 #include "chess.hpp"
+#include "trace.hpp"
 bool in_board(int8_t x, int8_t y)
 {
     return x <= 8 && x >= 1 && y <= 8 && y >= 1;
@@ -356,6 +357,29 @@ void piece_t::set_position(game_t &g, uint8_t x, uint8_t y)
 }
 
 std::vector<coordinate_t> piece_t::available_moves(const game_t &game, bool white, coordinate_t enpassant) const
+{
+    if (isinvalid())
+        return {};
+    std::vector<coordinate_t> moves = filter_check(game, pseudo_moves(game, white, enpassant), white);
+    auto castles = [&](coordinate_t to)
+    { return isking() && (to.x + 2 == position.x || to.x == position.x + 2); };
+    if (std::none_of(moves.begin(), moves.end(), castles))
+        return moves;
+    // castling is neither out of check nor across an attacked square, the
+    // square passed being the king's one step move that way
+    std::vector<coordinate_t> ret;
+    bool checked = game.in_check(white);
+    for (coordinate_t to : moves)
+    {
+        coordinate_t passed(uint8_t((to.x + position.x) / 2), to.y);
+        if (castles(to) && (checked || std::find(moves.begin(), moves.end(), passed) == moves.end()))
+            continue;
+        ret.push_back(to);
+    }
+    return ret;
+}
+
+std::vector<coordinate_t> piece_t::pseudo_moves(const game_t &game, bool white, coordinate_t enpassant) const
 {
 
     std::vector<coordinate_t> ret;
@@ -390,7 +414,7 @@ std::vector<coordinate_t> piece_t::available_moves(const game_t &game, bool whit
         assert(false);
         return {};
     }
-    return filter_check(game, ret, white);
+    return ret;
 }
 game_t::game_t() : white_king({0, 0}), black_king({0, 0})
 {
@@ -426,6 +450,10 @@ game_t::game_t() : white_king({0, 0}), black_king({0, 0})
 
     white_king = board[5 - 1][1 - 1].get_position();
     black_king = board[5 - 1][8 - 1].get_position();
+    for (const auto &row : board)
+        for (const auto &piece : row)
+            if (!piece.isinvalid())
+                material += material_unit(piece.iswhite(), piece.get_type());
 }
 
 piece_t game_t::get(uint8_t x, uint8_t y) const
@@ -439,20 +467,22 @@ piece_t &game_t::get(uint8_t x, uint8_t y)
     return board[x - 1][y - 1];
 }
 
-void game_t::draw()
-{
-    for (auto &row : board)
-        for (auto &piece : row)
-            piece.draw();
-}
-
 void game_t::move(uint8_t x, uint8_t y)
 {
-    if (enpassant != coordinate_t{0, 0})
+    bool capture = get(x, y) || (current_piece.ispawn() && x != current_piece.get_position().x);
+    if (get(x, y))
+        material -= material_unit(get(x, y).iswhite(), get(x, y).get_type());
+    halfmove_clock = capture || current_piece.ispawn() ? 0 : halfmove_clock + 1;
+    if (!white_turn)
+        fullmove_number++;
+    if (enpassant != coordinate_t{0, 0} && current_piece.ispawn())
     {
         if (x == enpassant.x)
             if (white_turn && y == enpassant.y + 1 || !white_turn && y == enpassant.y - 1)
+            {
+                material -= material_unit(!white_turn, piece_type::pawn);
                 get(enpassant) = piece_t();
+            }
     }
     if (current_piece.ispawn() && ((current_piece.get_position().y == 2 && y == 4) || (current_piece.get_position().y == 7 && y == 5)))
     // pawn just moved 2 places. save it's position
@@ -472,12 +502,14 @@ void game_t::move(uint8_t x, uint8_t y)
         // castling
         if (x == 3)
         {
-            piece_t &_rook = get(1, y);
+            piece_t _rook = get(1, y);
+            get(1, y) = piece_t();
             _rook.set_position(*this, 4, y);
         }
         if (x == 7)
         {
-            piece_t &_rook = get(8, y);
+            piece_t _rook = get(8, y);
+            get(8, y) = piece_t();
             _rook.set_position(*this, 6, y);
         }
     }
@@ -555,7 +587,7 @@ bool game_t::in_check(bool white) const
     {
         uint8_t dy = abs_diff(king.y, king_to_check.y);
         uint8_t dx = abs_diff(king.x, king_to_check.x);
-        if ((dy == 0 || dy == 1) && (dx == 0 && dx == 1) && (dx + dy != 0))
+        if ((dy == 0 || dy == 1) && (dx == 0 || dx == 1) && (dx + dy != 0))
             return true;
     }
 
@@ -673,4 +705,110 @@ bool game_t::in_check_mate(bool white) const
             return false;
     }
     return true;
-}
\ No newline at end of file
+}
+void game_t::play(move_t m)
+{
+    set_current_piece(get(m.from));
+    move(m.to.x, m.to.y);
+    if (m.promotion != piece_type::invalid)
+    {
+        get(m.to) = piece_t(m.to.x, m.to.y, white_turn, m.promotion);
+        material += material_unit(white_turn, m.promotion) - material_unit(white_turn, piece_type::pawn);
+    }
+    white_turn = !white_turn;
+}
+
+std::vector<move_t> game_t::legal_moves() const
+{
+    CHESS_TRACE_SCOPE("legal_moves");
+    std::vector<move_t> ret;
+    game_t g = *this;
+    uint8_t last_rank = white_turn ? 8 : 1;
+    for (const auto &row : board)
+        for (const auto &piece : row)
+        {
+            if (piece.isinvalid() || piece.iswhite() != white_turn)
+                continue;
+            g.set_current_piece(piece);
+            for (coordinate_t to : piece.available_moves(g, white_turn, enpassant))
+            {
+                if (piece.ispawn() && to.y == last_rank)
+                    for (piece_type t : {piece_type::queen, piece_type::rook, piece_type::bishop, piece_type::knight})
+                        ret.push_back({piece.get_position(), to, t});
+                else
+                    ret.push_back({piece.get_position(), to});
+            }
+        }
+    return ret;
+}
+
+bool game_t::is_capture(move_t m) const
+{
+    // a pawn changing file onto an empty square is taking en passant
+    return get(m.to) || (get(m.from).ispawn() && m.from.x != m.to.x);
+}
+
+namespace
+{
+    // 12 piece kinds * 64 squares, side to move, 4 castling rights, 8 en passant files
+    constexpr unsigned zobrist_side = 12 * 64;
+    constexpr unsigned zobrist_castling = zobrist_side + 1;
+    constexpr unsigned zobrist_enpassant = zobrist_castling + 4;
+    constexpr auto zobrist = []
+    {
+        std::array<uint64_t, zobrist_enpassant + 8> keys{};
+        uint64_t state = 0x2545f4914f6cdd1dull;
+        for (auto &key : keys)
+        {
+            // splitmix64
+            uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            key = z ^ (z >> 31);
+        }
+        return keys;
+    }();
+}
+
+uint64_t zobrist_key(const piece_t &piece)
+{
+    unsigned kind = (unsigned(piece.get_type()) - 1) * 2 + piece.iswhite();
+    coordinate_t p = piece.get_position();
+    return zobrist[kind * 64 + (p.x - 1) * 8 + (p.y - 1)];
+}
+
+uint64_t game_t::hash() const
+{
+    uint64_t key = 0;
+    for (const auto &row : board)
+        for (const auto &piece : row)
+            if (!piece.isinvalid())
+                key ^= zobrist_key(piece);
+    if (!white_turn)
+        key ^= zobrist[zobrist_side];
+    unsigned rights = castling_rights();
+    for (unsigned right = 0; right < 4; right++)
+        if (rights & (1u << right))
+            key ^= zobrist[zobrist_castling + right];
+    if (enpassant != coordinate_t{0, 0})
+        key ^= zobrist[zobrist_enpassant + enpassant.x - 1];
+    return key;
+}
+
+unsigned game_t::castling_rights() const
+{
+    unsigned rights = 0, right = 0;
+    for (uint8_t y : {1, 8})
+    {
+        piece_t king = get(5, y);
+        bool king_home = king.isking() && king.iswhite() == (y == 1) && !king.moved();
+        for (uint8_t x : {8, 1})
+        {
+            piece_t rook = get(x, y);
+            if (king_home && rook.isrook() && rook.iswhite() == (y == 1) && !rook.moved())
+                rights |= 1u << right;
+            right++;
+        }
+    }
+    return rights;
+}
@@ -1,14 +1,14 @@
 #pragma once
-#include <unordered_map>
 #include <cassert>
+#include <cstdint>
 #include <cstdio>
 #include <memory>
 #include <algorithm>
-#include "rendering.hpp"
-#include <stb_image.hpp>
 #include <iostream>
 #include <array>
-#include "images.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
 struct coordinate_t
 {
     coordinate_t(uint8_t x, uint8_t y) : x(x), y(y)
@@ -43,66 +43,13 @@ struct piece_t
     {
     }
 
-    piece_t(uint8_t x, uint8_t y, bool white, piece_type t) : position({x, y}), type(t), white(white)
+    piece_t(uint8_t x, uint8_t y, bool white, piece_type t, bool moved = false) : position({x, y}), has_moved(moved), type(t), white(white)
     {
-        std::string name;
-        // stbi_set_flip_vertically_on_load(!white);
-        const std::vector<unsigned char> *data;
-        name = white ? "white-" : "black-";
-        switch (t)
-        {
-        case piece_type::pawn:
-            name += "pawn";
-            data = white ? &white_pawn_png : &black_pawn_png;
-            break;
-        case piece_type::rook:
-            name += "rook";
-            data = white ? &white_rook_png : &black_rook_png;
-            break;
-        case piece_type::king:
-            name += "king";
-            data = white ? &white_king_png : &black_king_png;
-            break;
-        case piece_type::queen:
-            name += "queen";
-            data = white ? &white_queen_png : &black_queen_png;
-            break;
-        case piece_type::bishop:
-            name += "bishop";
-            data = white ? &white_bishop_png : &black_bishop_png;
-            break;
-        case piece_type::knight:
-            name += "knight";
-            data = white ? &white_knight_png : &black_knight_png;
-            break;
-        default:
-            break;
-        }
-
-        int w, h;
-        static std::unordered_map<std::string, drawing_params> piece_cache;
-        try
-        {
-            params = piece_cache.at(name);
-        }
-        catch (std::out_of_range &e)
-        {
-
-            // auto image = stbi_load((name + ".png").data(), &w, &h, nullptr, 4);
-            auto image = stbi_load_from_memory(data->data(), data->size(), &w, &h, nullptr, 4);
-            params = setup_square(image, w, h, 0.25f);
-            stbi_image_free(image);
-            piece_cache[name] = params;
-        }
-        position = {x, y};
     }
     std::vector<coordinate_t> available_moves(const game_t &game, bool white, coordinate_t enpassant) const;
+    // as above but moves that leave the own king in check are kept
+    std::vector<coordinate_t> pseudo_moves(const game_t &game, bool white, coordinate_t enpassant) const;
 
-    void draw() const
-    {
-        if (!isinvalid())
-            params.draw(position.x, position.y);
-    };
     inline bool ispawn() const { return type == piece_type::pawn; }
     inline bool isrook() const { return type == piece_type::rook; }
     inline bool isking() const { return type == piece_type::king; }
@@ -114,6 +61,7 @@ struct piece_t
     operator bool() { return !isinvalid(); }
     piece_type get_type() const { return type; }
     coordinate_t get_position() const { return position; }
+    bool moved() const { return has_moved; }
     // sets has_moved to true
     void set_position(game_t &g, uint8_t x, uint8_t y);
 
@@ -127,9 +75,21 @@ struct piece_t
 private:
     coordinate_t position;
     bool has_moved = false;
-    drawing_params params;
     piece_type type;
-    bool white;
+    bool white = false;
+};
+
+struct move_t
+{
+    coordinate_t from{0, 0};
+    coordinate_t to{0, 0};
+    piece_type promotion = piece_type::invalid;
+    bool operator==(move_t right) const
+    {
+        return from == right.from && to == right.to && promotion == right.promotion;
+    }
+    bool operator!=(move_t right) const { return !(*this == right); }
+    bool isnull() const { return from == coordinate_t{0, 0}; }
 };
 
 struct game_t
@@ -179,8 +139,25 @@ struct game_t
                 black_king = p.get_position();
     }
 
-    void draw();
     void move(uint8_t x, uint8_t y);
+    // moves the piece on m.from, promotes it if asked and passes the turn
+    void play(move_t m);
+    // every legal move of the side to move, promotions once per piece type
+    std::vector<move_t> legal_moves() const;
+    bool is_capture(move_t m) const;
+    // zobrist key of the board, side to move, castling rights and en passant
+    uint64_t hash() const;
+    // bit 0 white short, 1 white long, 2 black short, 3 black long, from has_moved
+    unsigned castling_rights() const;
+
+    // parses a FEN without allocating, the move counters may be left out. With
+    // `operations` whatever follows the fields is handed back instead of
+    // rejected, as in EPD.
+    // Returns false on malformed or impossible input, `game` is then unspecified.
+    static bool from_fen(std::string_view fen, game_t &game, std::string_view *operations = nullptr);
+    // writes the FEN with a terminating zero, returns its length or 0 if `size` is too small
+    size_t to_fen(char *out, size_t size) const;
+    std::string to_fen() const;
 
     bool in_check(bool white) const;
     bool in_check_mate(bool white) const;
@@ -192,6 +169,11 @@ struct game_t
     bool promote = false;
     bool white_check = false;
     bool black_check = false;
+    // moves since the last capture or pawn move, and the move number
+    unsigned halfmove_clock = 0;
+    unsigned fullmove_number = 1;
+    // material_unit summed over the pieces, kept by move and play
+    uint64_t material = 0;
 
     coordinate_t white_king;
     coordinate_t black_king;
@@ -199,3 +181,21 @@ struct game_t
 private:
     piece_t current_piece;
 };
+
+// Material signature: four bits of count per colour and piece type, black in
+// the low half. Adding material_unit for every piece builds it and a capture
+// or promotion only adds or subtracts units, so game_t keeps it as it moves.
+// Exact for up to 15 pieces of a kind.
+constexpr uint64_t material_unit(bool white, piece_type type)
+{
+    return uint64_t(1) << ((white ? 28 : 0) + 4 * int(type));
+}
+
+constexpr unsigned material_count(uint64_t key, bool white, piece_type type)
+{
+    return unsigned(key >> ((white ? 28 : 0) + 4 * int(type))) & 15;
+}
+
+// zobrist key of one piece on its square, game_t::hash is these XORed
+// together with the side, castling and en passant keys
+uint64_t zobrist_key(const piece_t &piece);
@@ -0,0 +1,447 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "diagram.hpp"
+
+namespace
+{
+    // separable tent filter at least a destination pixel wide, so shrinking
+    // averages and enlarging interpolates. Works on premultiplied channels.
+    std::vector<float> resample(const std::vector<float> &source, int width, int height, int to_width, int to_height)
+    {
+        auto pass = [](const std::vector<float> &in, int length, int lines, int to_length, bool rows)
+        {
+            std::vector<float> out(size_t(to_length) * lines * 4);
+            float ratio = float(length) / to_length;
+            float radius = std::max(1.0f, ratio);
+            for (int i = 0; i < to_length; i++)
+            {
+                float centre = (i + 0.5f) * ratio - 0.5f;
+                int first = int(std::floor(centre - radius)) + 1, last = int(std::ceil(centre + radius)) - 1;
+                float total = 0;
+                for (int j = first; j <= last; j++)
+                    total += std::max(0.0f, 1 - std::abs(j - centre) / radius);
+                for (int j = first; j <= last; j++)
+                {
+                    float weight = std::max(0.0f, 1 - std::abs(j - centre) / radius) / total;
+                    int from = std::min(std::max(j, 0), length - 1);
+                    for (int line = 0; line < lines; line++)
+                    {
+                        // rows: along x within a row, otherwise along y within a column
+                        size_t s = rows ? (size_t(line) * length + from) : (size_t(from) * lines + line);
+                        size_t d = rows ? (size_t(line) * to_length + i) : (size_t(i) * lines + line);
+                        for (int c = 0; c < 4; c++)
+                            out[4 * d + c] += weight * in[4 * s + c];
+                    }
+                }
+            }
+            return out;
+        };
+        return pass(pass(source, width, height, to_width, true), height, to_width, to_height, false);
+    }
+
+    image_t scale_premultiplied(const image_t &image, int size)
+    {
+        std::vector<float> premultiplied(image.pixels.size());
+        for (size_t i = 0; i < image.pixels.size(); i += 4)
+        {
+            float alpha = image.pixels[i + 3] / 255.0f;
+            for (int c = 0; c < 3; c++)
+                premultiplied[i + c] = image.pixels[i + c] * alpha;
+            premultiplied[i + 3] = image.pixels[i + 3];
+        }
+        std::vector<float> scaled = resample(premultiplied, image.width, image.height, size, size);
+        image_t out{size, size, std::vector<uint8_t>(scaled.size())};
+        for (size_t i = 0; i < scaled.size(); i += 4)
+        {
+            uint8_t alpha = uint8_t(std::min(std::max(scaled[i + 3] + 0.5f, 0.0f), 255.0f));
+            out.pixels[i + 3] = alpha;
+            // a premultiplied channel never exceeds alpha, blend_row relies on it
+            for (int c = 0; c < 3; c++)
+                out.pixels[i + c] = uint8_t(std::min(std::max(scaled[i + c] + 0.5f, 0.0f), float(alpha)));
+        }
+        return out;
+    }
+
+    // x * y / 255 rounded, exact for bytes
+    inline unsigned mul_255(unsigned x, unsigned y)
+    {
+        unsigned t = x * y + 128;
+        return (t + (t >> 8)) >> 8;
+    }
+
+    // premultiplied source over destination: d = s + d * (255 - a) / 255
+    void blend_row(uint8_t *destination, const uint8_t *source, int pixels)
+    {
+        int i = 0;
+#ifdef __SSE2__
+        // four pixels at a time, in 16 bit lanes with the same rounding as below
+        const __m128i zero = _mm_setzero_si128(), full = _mm_set1_epi16(255), half = _mm_set1_epi16(128);
+        for (; i + 4 <= pixels; i += 4)
+        {
+            __m128i s = _mm_loadu_si128((const __m128i *)(source + 4 * i));
+            __m128i d = _mm_loadu_si128((const __m128i *)(destination + 4 * i));
+            // each pixel's alpha in all four of its bytes
+            __m128i a = _mm_srli_epi32(s, 24);
+            a = _mm_or_si128(a, _mm_slli_epi32(a, 8));
+            a = _mm_or_si128(a, _mm_slli_epi32(a, 16));
+            auto half_blend = [&](__m128i s16, __m128i d16, __m128i a16)
+            {
+                __m128i t = _mm_add_epi16(_mm_mullo_epi16(d16, _mm_sub_epi16(full, a16)), half);
+                t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+                return _mm_add_epi16(s16, t);
+            };
+            __m128i low = half_blend(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(a, zero));
+            __m128i high = half_blend(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(a, zero));
+            _mm_storeu_si128((__m128i *)(destination + 4 * i), _mm_packus_epi16(low, high));
+        }
+#endif
+        for (; i < pixels; i++)
+        {
+            unsigned inverse = 255 - source[4 * i + 3];
+            for (int c = 0; c < 4; c++)
+                destination[4 * i + c] = uint8_t(source[4 * i + c] + mul_255(destination[4 * i + c], inverse));
+        }
+    }
+
+    uint32_t crc32(const uint8_t *data, size_t length, uint32_t crc = 0)
+    {
+        static const auto table = []
+        {
+            std::array<uint32_t, 256> t;
+            for (uint32_t n = 0; n < 256; n++)
+            {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++)
+                    c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                t[n] = c;
+            }
+            return t;
+        }();
+        crc = ~crc;
+        for (size_t i = 0; i < length; i++)
+            crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    uint32_t adler32(const std::vector<uint8_t> &data)
+    {
+        uint32_t a = 1, b = 0;
+        for (size_t i = 0; i < data.size();)
+        {
+            // the largest run whose sums cannot overflow before the modulo
+            size_t end = std::min(data.size(), i + 5552);
+            for (; i < end; i++)
+            {
+                a += data[i];
+                b += a;
+            }
+            a %= 65521;
+            b %= 65521;
+        }
+        return b << 16 | a;
+    }
+
+    // deflate bits, least significant first
+    struct bit_writer_t
+    {
+        std::vector<uint8_t> &out;
+        uint64_t bits = 0;
+        int count = 0;
+
+        void write(uint32_t value, int length)
+        {
+            bits |= uint64_t(value) << count;
+            count += length;
+            while (count >= 8)
+            {
+                out.push_back(uint8_t(bits));
+                bits >>= 8;
+                count -= 8;
+            }
+        }
+        // Huffman codes are defined most significant bit first
+        void write_code(uint32_t code, int length)
+        {
+            uint32_t reversed = 0;
+            for (int i = 0; i < length; i++)
+                reversed |= ((code >> i) & 1) << (length - 1 - i);
+            write(reversed, length);
+        }
+        void flush()
+        {
+            if (count)
+                out.push_back(uint8_t(bits));
+            bits = 0;
+            count = 0;
+        }
+    };
+
+    void write_literal(bit_writer_t &writer, unsigned symbol)
+    {
+        if (symbol < 144)
+            writer.write_code(0x30 + symbol, 8);
+        else if (symbol < 256)
+            writer.write_code(0x190 + symbol - 144, 9);
+        else if (symbol < 280)
+            writer.write_code(symbol - 256, 7);
+        else
+            writer.write_code(0xc0 + symbol - 280, 8);
+    }
+
+    constexpr uint16_t length_base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                          35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    constexpr uint8_t length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                          3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    constexpr uint16_t distance_base[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129,
+                                            193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097,
+                                            6145, 8193, 12289, 16385, 24577};
+    constexpr uint8_t distance_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+                                            6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+    void write_match(bit_writer_t &writer, unsigned length, unsigned distance)
+    {
+        int l = 28;
+        while (length_base[l] > length)
+            l--;
+        write_literal(writer, 257 + l);
+        writer.write(length - length_base[l], length_extra[l]);
+        int d = 29;
+        while (distance_base[d] > distance)
+            d--;
+        writer.write_code(d, 5);
+        writer.write(distance - distance_base[d], distance_extra[d]);
+    }
+
+    // how many bytes from a and b are equal, up to limit
+    unsigned common_prefix(const uint8_t *a, const uint8_t *b, unsigned limit)
+    {
+        unsigned length = 0;
+        for (; length + 8 <= limit; length += 8)
+        {
+            uint64_t x, y;
+            memcpy(&x, a + length, 8);
+            memcpy(&y, b + length, 8);
+            if (x != y)
+                return length + unsigned(__builtin_ctzll(x ^ y)) / 8;
+        }
+        while (length < limit && a[length] == b[length])
+            length++;
+        return length;
+    }
+
+    // a zlib stream of one fixed Huffman block, greedy LZ77 matches found
+    // through a hash of the next three bytes with short chains
+    std::vector<uint8_t> zlib_compress(const std::vector<uint8_t> &data)
+    {
+        constexpr int window = 1 << 15, hash_bits = 15, max_chain = 32;
+        constexpr unsigned min_match = 3, max_match = 258;
+        std::vector<uint8_t> out = {0x78, 0x01};
+        bit_writer_t writer{out};
+        writer.write(1, 1); // final block
+        writer.write(1, 2); // fixed codes
+
+        std::vector<int32_t> head(1 << hash_bits, -1), previous(window, -1);
+        auto hash = [&](size_t i)
+        { return ((data[i] << 10) ^ (data[i + 1] << 5) ^ data[i + 2]) & ((1 << hash_bits) - 1); };
+        auto insert = [&](size_t i)
+        {
+            if (i + min_match > data.size())
+                return;
+            uint32_t h = hash(i);
+            previous[i % window] = head[h];
+            head[h] = int32_t(i);
+        };
+        for (size_t i = 0; i < data.size();)
+        {
+            unsigned best = 0, best_distance = 0;
+            if (i + min_match <= data.size())
+            {
+                unsigned longest = unsigned(std::min<size_t>(max_match, data.size() - i));
+                int32_t candidate = head[hash(i)];
+                for (int chain = 0; candidate >= 0 && i - candidate <= window - 1 && chain < max_chain; chain++)
+                {
+                    unsigned length = common_prefix(&data[candidate], &data[i], longest);
+                    if (length > best)
+                    {
+                        best = length;
+                        best_distance = unsigned(i - candidate);
+                        if (length == longest)
+                            break;
+                    }
+                    int32_t next = previous[candidate % window];
+                    if (next >= candidate)
+                        break;
+                    candidate = next;
+                }
+            }
+            if (best >= min_match)
+            {
+                write_match(writer, best, best_distance);
+                // inside long runs only the last positions are worth finding again
+                for (unsigned k = best > 32 ? best - 4 : 0; k < best; k++)
+                    insert(i + k);
+                i += best;
+            }
+            else
+            {
+                write_literal(writer, data[i]);
+                insert(i);
+                i++;
+            }
+        }
+        write_literal(writer, 256);
+        writer.flush();
+        uint32_t check = adler32(data);
+        for (int shift = 24; shift >= 0; shift -= 8)
+            out.push_back(uint8_t(check >> shift));
+        return out;
+    }
+
+    void put_u32(std::vector<uint8_t> &out, uint32_t value)
+    {
+        for (int shift = 24; shift >= 0; shift -= 8)
+            out.push_back(uint8_t(value >> shift));
+    }
+
+    void put_chunk(std::vector<uint8_t> &out, const char *type, const std::vector<uint8_t> &data)
+    {
+        put_u32(out, uint32_t(data.size()));
+        size_t start = out.size();
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data.begin(), data.end());
+        put_u32(out, crc32(out.data() + start, out.size() - start));
+    }
+
+    // PNG filter `filter` of a row given the row above, returns the sum of the
+    // magnitudes of the result. One loop a filter so each vectorises.
+    uint64_t filter_row(uint8_t filter, const uint8_t *row, const uint8_t *up, size_t stride, uint8_t *out)
+    {
+        switch (filter)
+        {
+        case 0:
+            memcpy(out, row, stride);
+            break;
+        case 1:
+            memcpy(out, row, 4);
+            for (size_t i = 4; i < stride; i++)
+                out[i] = uint8_t(row[i] - row[i - 4]);
+            break;
+        case 2:
+            for (size_t i = 0; i < stride; i++)
+                out[i] = uint8_t(row[i] - up[i]);
+            break;
+        case 3:
+            for (size_t i = 0; i < 4; i++)
+                out[i] = uint8_t(row[i] - up[i] / 2);
+            for (size_t i = 4; i < stride; i++)
+                out[i] = uint8_t(row[i] - (row[i - 4] + up[i]) / 2);
+            break;
+        default:
+            // with nothing to the left the predictor is the byte above
+            for (size_t i = 0; i < 4; i++)
+                out[i] = uint8_t(row[i] - up[i]);
+            for (size_t i = 4; i < stride; i++)
+            {
+                // the Paeth predictor, nearest of left, up and up left to left + up - up left
+                int a = row[i - 4], b = up[i], c = up[i - 4];
+                int pa = std::abs(b - c), pb = std::abs(a - c), pc = std::abs(a + b - 2 * c);
+                int predicted = pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+                out[i] = uint8_t(row[i] - predicted);
+            }
+            break;
+        }
+        uint64_t sum = 0;
+        for (size_t i = 0; i < stride; i++)
+            sum += uint8_t(std::abs(int8_t(out[i])));
+        return sum;
+    }
+}
+
+diagram_renderer::diagram_renderer(int square_size, const std::array<std::array<image_t, 2>, 7> &sprites)
+    : square(square_size)
+{
+    for (size_t type = 1; type < sprites.size(); type++)
+        for (int white = 0; white < 2; white++)
+            if (sprites[type][white].width)
+                scaled[type][white] = scale_premultiplied(sprites[type][white], square);
+}
+
+void diagram_renderer::render(const game_t &game, image_t &out) const
+{
+    out.width = out.height = size();
+    out.pixels.resize(size_t(out.width) * out.height * 4);
+    size_t stride = size_t(out.width) * 4;
+    for (uint8_t y = 1; y <= 8; y++)
+        for (uint8_t x = 1; x <= 8; x++)
+        {
+            uint8_t *corner = out.pixels.data() + size_t(8 - y) * square * stride + size_t(x - 1) * square * 4;
+            const std::array<uint8_t, 4> &colour = (x + y) % 2 ? light : dark;
+            for (int i = 0; i < square; i++)
+                memcpy(corner + 4 * i, colour.data(), 4);
+            for (int row = 1; row < square; row++)
+                memcpy(corner + row * stride, corner, size_t(square) * 4);
+
+            const piece_t &piece = game.board[x - 1][y - 1];
+            if (piece.isinvalid())
+                continue;
+            const image_t &sprite = scaled[int(piece.get_type())][piece.iswhite()];
+            if (!sprite.width)
+                continue;
+            for (int row = 0; row < square; row++)
+                blend_row(corner + row * stride, sprite.pixels.data() + size_t(row) * square * 4, square);
+        }
+}
+
+std::vector<uint8_t> encode_png(const image_t &image)
+{
+    // each row takes whichever filter leaves the smallest sum of magnitudes
+    size_t stride = size_t(image.width) * 4;
+    std::vector<uint8_t> filtered;
+    filtered.reserve((stride + 1) * image.height);
+    std::vector<uint8_t> candidate(stride), best(stride), zero(stride);
+    for (int y = 0; y < image.height; y++)
+    {
+        const uint8_t *row = image.pixels.data() + y * stride;
+        const uint8_t *up = y ? row - stride : zero.data();
+        uint64_t best_sum = UINT64_MAX;
+        uint8_t best_filter = 0;
+        for (uint8_t filter = 0; filter < 5; filter++)
+        {
+            uint64_t sum = filter_row(filter, row, up, stride, candidate.data());
+            if (sum < best_sum)
+            {
+                best_sum = sum;
+                best_filter = filter;
+                best.swap(candidate);
+            }
+        }
+        filtered.push_back(best_filter);
+        filtered.insert(filtered.end(), best.begin(), best.end());
+    }
+
+    std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    std::vector<uint8_t> header;
+    put_u32(header, uint32_t(image.width));
+    put_u32(header, uint32_t(image.height));
+    // 8 bits, RGBA, deflate, adaptive filters, not interlaced
+    header.insert(header.end(), {8, 6, 0, 0, 0});
+    put_chunk(png, "IHDR", header);
+    put_chunk(png, "IDAT", zlib_compress(filtered));
+    put_chunk(png, "IEND", {});
+    return png;
+}
+
+bool write_png(const char *path, const image_t &image)
+{
+    std::vector<uint8_t> png = encode_png(image);
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        return false;
+    bool written = fwrite(png.data(), 1, png.size(), file) == png.size();
+    return fclose(file) == 0 && written;
+}
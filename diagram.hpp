@@ -0,0 +1,39 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "chess.hpp"
+
+// RGBA pixels, four bytes each, row by row from the top
+struct image_t
+{
+    int width = 0, height = 0;
+    std::vector<uint8_t> pixels;
+};
+
+// Draws positions into square images without OpenGL, white at the bottom.
+// The piece images are scaled to the square size once, when constructed, so
+// drawing a diagram is filling squares and alpha blending sprites over them.
+// const members are safe to call from several threads.
+class diagram_renderer
+{
+public:
+    // sprites indexed by piece_type then colour, any size, straight alpha
+    diagram_renderer(int square_size, const std::array<std::array<image_t, 2>, 7> &sprites);
+    int size() const { return 8 * square; }
+    // out is resized, its storage is reused from one diagram to the next
+    void render(const game_t &game, image_t &out) const;
+
+    std::array<uint8_t, 4> light{0xff, 0xff, 0xff, 0xff};
+    std::array<uint8_t, 4> dark{0xd2, 0x69, 0x1e, 0xff};
+
+private:
+    int square;
+    // premultiplied, square_size a side
+    std::array<std::array<image_t, 2>, 7> scaled;
+};
+
+// an 8 bit RGBA PNG, compressed with fixed Huffman codes
+std::vector<uint8_t> encode_png(const image_t &image);
+// false if the file could not be written
+bool write_png(const char *path, const image_t &image);
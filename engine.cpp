@@ -0,0 +1,202 @@
+#include "engine.hpp"
+#include "trace.hpp"
+
+engine_worker::engine_worker(void (*wake)()) : wake(wake), searcher(tt), random(uint64_t(steady_ns())),
+                                               thread(&engine_worker::run, this)
+{
+}
+
+engine_worker::~engine_worker()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+        searcher.stop = true;
+    }
+    cv.notify_one();
+    thread.join();
+}
+
+uint64_t engine_worker::go(const game_t &game)
+{
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        generation = ++submitted_generation;
+        bool predicted_move = (state == state_t::pondering || state == state_t::pondered) && game.hash() == predicted_key;
+        if (predicted_move)
+        {
+            ponder_hit = generation;
+            // time spent pondering counts towards this move
+            if (state == state_t::pondering)
+                searcher.deadline = ponder_start + int64_t(move_time_ms) * 1000000;
+        }
+        else
+        {
+            if (state == state_t::thinking || state == state_t::pondering)
+                searcher.stop = true;
+            pending = game;
+            pending_generation = generation;
+        }
+    }
+    cv.notify_one();
+    return generation;
+}
+
+void engine_worker::stop()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    // a reply already on its way gets a generation nobody waits for
+    ++submitted_generation;
+    pending_generation = 0;
+    ponder_hit = 0;
+    predicted_key = 0;
+    if (state == state_t::thinking || state == state_t::pondering)
+        searcher.stop = true;
+}
+
+bool engine_worker::open_book(const char *path)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    book = polyglot_book(path);
+    return book.is_open();
+}
+
+size_t engine_worker::open_tablebases(const char *directory)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t count = tablebases.open_directory(directory);
+    searcher.tablebases = count ? &tablebases : nullptr;
+    return count;
+}
+
+void engine_worker::publish(uint64_t generation, const game_t &game, const search_info_t &info, bool hit,
+                            move_t book_move)
+{
+    engine_reply_t &reply = replies.back();
+    reply.generation = generation;
+    reply.info = info;
+    reply.ponder_hit = hit;
+    reply.book = !book_move.isnull();
+    reply.move = move_t();
+    if (reply.book)
+        reply.move = book_move;
+    else if (!info.pv.empty())
+        reply.move = info.pv.front();
+    else
+    {
+        // stopped before the first iteration completed
+        auto moves = game.legal_moves();
+        if (!moves.empty())
+            reply.move = moves.front();
+    }
+    replies.publish();
+    if (wake)
+        wake();
+}
+
+void engine_worker::publish_progress(const search_info_t &info)
+{
+    if (!report_progress.load(std::memory_order_relaxed))
+        return;
+    progress_snapshots.back() = info;
+    progress_snapshots.publish();
+    if (wake)
+        wake();
+}
+
+void engine_worker::run()
+{
+    CHESS_TRACE_THREAD("engine");
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        cv.wait(lock, [this]
+                { return quit || pending_generation || ponder_hit; });
+        if (quit)
+            return;
+        if (ponder_hit)
+        {
+            // the ponder search finished early and the human then played into it
+            publish(ponder_hit, predicted, pondered, true);
+            ponder_hit = 0;
+            state = state_t::idle;
+            continue;
+        }
+
+        working = pending;
+        uint64_t generation = pending_generation;
+        pending_generation = 0;
+
+        // a book move is played at once and there is nothing to ponder on
+        move_t book_move = book.is_open() ? book.pick(working, random()) : move_t();
+        if (!book_move.isnull())
+        {
+            auto moves = working.legal_moves();
+            if (std::find(moves.begin(), moves.end(), book_move) != moves.end())
+            {
+                publish(generation, working, search_info_t(), false, book_move);
+                state = state_t::idle;
+                continue;
+            }
+        }
+
+        state = state_t::thinking;
+        searcher.stop = false;
+        searcher.deadline = 0;
+        search_limits_t limits;
+        limits.time = std::chrono::milliseconds(move_time_ms);
+        lock.unlock();
+
+        tt.new_search();
+        search_info_t info = searcher.search(working, limits, [this](const search_info_t &i)
+                                             { publish_progress(i); });
+
+        lock.lock();
+        publish(generation, working, info, false);
+        if (quit || pending_generation || !ponder || info.pv.empty() || generation != submitted_generation)
+        {
+            state = state_t::idle;
+            continue;
+        }
+
+        predicted = working;
+        predicted.play(info.pv[0]);
+        // a table cutoff can cut the variation short, the table still knows the reply
+        move_t expected;
+        tt_entry_t entry;
+        if (info.pv.size() > 1)
+            expected = info.pv[1];
+        else if (tt.probe(predicted.hash(), entry))
+            expected = entry.move;
+        if (expected.isnull())
+        {
+            state = state_t::idle;
+            continue;
+        }
+        predicted.play(expected);
+        predicted_key = predicted.hash();
+        ponder_start = steady_ns();
+        state = state_t::pondering;
+        searcher.stop = false;
+        searcher.deadline = 0;
+        lock.unlock();
+
+        // no limits, ended by go() or stop()
+        tt.new_search();
+        pondered = searcher.search(predicted, search_limits_t(), [this](const search_info_t &i)
+                                   { publish_progress(i); });
+
+        lock.lock();
+        if (ponder_hit)
+        {
+            publish(ponder_hit, predicted, pondered, true);
+            ponder_hit = 0;
+            state = state_t::idle;
+        }
+        else if (searcher.stop || quit)
+            state = state_t::idle;
+        else
+            state = state_t::pondered;
+    }
+}
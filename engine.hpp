@@ -0,0 +1,101 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <thread>
+#include "analysis.hpp"
+#include "book.hpp"
+#include "search.hpp"
+
+struct engine_reply_t
+{
+    // generation returned by the go() this answers, 0 means nothing yet
+    uint64_t generation = 0;
+    // null when the engine has no legal move
+    move_t move;
+    search_info_t info;
+    // the position was the one pondered on while the human thought
+    bool ponder_hit = false;
+    // the move came from the opening book, info is empty
+    bool book = false;
+};
+
+// Plays one side in the GUI. Searches on its own thread and, once it has
+// replied, keeps searching the position after the reply it expects from the
+// human. If the human plays that move the ponder search becomes the answer,
+// otherwise it is stopped at the next node. Both searches share one
+// transposition table.
+class engine_worker
+{
+public:
+    engine_worker(void (*wake)() = nullptr);
+    ~engine_worker();
+    engine_worker(const engine_worker &) = delete;
+    engine_worker &operator=(const engine_worker &) = delete;
+
+    // think about a position with the engine to move
+    uint64_t go(const game_t &game);
+    // give up thinking and pondering, nothing more is published for earlier go()s
+    void stop();
+    // newest published reply. Only call from one thread.
+    const engine_reply_t &latest() { return replies.acquire(); }
+    // play from a Polyglot book while it knows the position. Call before the
+    // first go(). False if the file is not a book.
+    bool open_book(const char *path);
+    // searches with the distance to mate tables tb-gen wrote to the directory
+    // and the Syzygy .rtbw and .rtbz files in it. Call before the first go().
+    // Returns how many tables were found.
+    size_t open_tablebases(const char *directory);
+
+    // every finished iteration, thinking or pondering, while report_progress
+    // is set. Only call from one thread.
+    const search_info_t &progress() { return progress_snapshots.acquire(); }
+
+    std::atomic<bool> ponder{true};
+    std::atomic<int> move_time_ms{1000};
+    std::atomic<bool> report_progress{false};
+
+private:
+    enum class state_t
+    {
+        idle,
+        thinking,
+        pondering,
+        // the ponder search finished before the human moved
+        pondered,
+    };
+    void run();
+    void publish(uint64_t generation, const game_t &game, const search_info_t &info, bool ponder_hit,
+                 move_t book_move = move_t());
+    void publish_progress(const search_info_t &info);
+
+    void (*wake)();
+    transposition_table tt;
+    searcher_t searcher;
+    polyglot_book book;
+    tablebase_set tablebases;
+    std::mt19937_64 random;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    state_t state = state_t::idle;
+    game_t pending;
+    uint64_t pending_generation = 0;
+    uint64_t submitted_generation = 0;
+    // position predicted after the human's reply and when pondering on it began
+    game_t predicted;
+    uint64_t predicted_key = 0;
+    int64_t ponder_start = 0;
+    // go() that found the predicted position
+    uint64_t ponder_hit = 0;
+    bool quit = false;
+
+    game_t working;
+    search_info_t pondered;
+    snapshot_buffer<engine_reply_t> replies;
+    snapshot_buffer<search_info_t> progress_snapshots;
+    std::thread thread;
+};
@@ -0,0 +1,329 @@
+#include <cstdlib>
+#include "chess.hpp"
+
+namespace
+{
+    piece_type type_from_letter(char c)
+    {
+        switch (c | 0x20)
+        {
+        case 'p':
+            return piece_type::pawn;
+        case 'r':
+            return piece_type::rook;
+        case 'k':
+            return piece_type::king;
+        case 'b':
+            return piece_type::bishop;
+        case 'q':
+            return piece_type::queen;
+        case 'n':
+            return piece_type::knight;
+        default:
+            return piece_type::invalid;
+        }
+    }
+
+    // indexed by piece_type
+    constexpr char letters[] = "?prkbqn";
+
+    // appends a space and the decimal digits of value
+    size_t write_number(char *out, size_t n, unsigned value)
+    {
+        char digits[10];
+        int count = 0;
+        do
+        {
+            digits[count++] = char('0' + value % 10);
+            value /= 10;
+        } while (value);
+        out[n++] = ' ';
+        while (count)
+            out[n++] = digits[--count];
+        return n;
+    }
+
+    bool is_space(char c) { return c == ' ' || c == '\t'; }
+
+    // advances past one run of spaces, false if there was none
+    bool skip_spaces(std::string_view s, size_t &i)
+    {
+        size_t start = i;
+        while (i < s.size() && is_space(s[i]))
+            i++;
+        return i != start;
+    }
+
+    // game_t::in_check without collecting the pieces first, which is most of
+    // the cost of parsing a FEN. Looks outwards from the king.
+    bool king_attacked(const game_t &game, bool white)
+    {
+        coordinate_t king = white ? game.white_king : game.black_king;
+        auto enemy = [&](int x, int y, piece_type type)
+        {
+            if (x < 1 || x > 8 || y < 1 || y > 8)
+                return false;
+            const piece_t &piece = game.board[x - 1][y - 1];
+            return piece.get_type() == type && piece.iswhite() != white;
+        };
+        int forward = white ? 1 : -1;
+        if (enemy(king.x - 1, king.y + forward, piece_type::pawn) || enemy(king.x + 1, king.y + forward, piece_type::pawn))
+            return true;
+        static constexpr int jumps[8][2] = {{1, 2}, {2, 1}, {2, -1}, {1, -2}, {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2}};
+        for (const auto &jump : jumps)
+            if (enemy(king.x + jump[0], king.y + jump[1], piece_type::knight))
+                return true;
+        static constexpr int rays[8][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {1, -1}, {-1, 1}, {-1, -1}};
+        for (int ray = 0; ray < 8; ray++)
+        {
+            int x = king.x + rays[ray][0], y = king.y + rays[ray][1];
+            while (x >= 1 && x <= 8 && y >= 1 && y <= 8 && game.board[x - 1][y - 1].isinvalid())
+                x += rays[ray][0], y += rays[ray][1];
+            piece_type slider = ray < 4 ? piece_type::rook : piece_type::bishop;
+            if (enemy(x, y, slider) || enemy(x, y, piece_type::queen))
+                return true;
+        }
+        return false;
+    }
+
+    // reads a decimal counter, false if there are no digits or it is absurd
+    bool parse_number(std::string_view s, size_t &i, unsigned &value)
+    {
+        size_t start = i;
+        value = 0;
+        while (i < s.size() && s[i] >= '0' && s[i] <= '9' && i - start < 6)
+            value = value * 10 + (s[i++] - '0');
+        return i != start && (i == s.size() || !(s[i] >= '0' && s[i] <= '9'));
+    }
+}
+
+bool game_t::from_fen(std::string_view fen, game_t &game, std::string_view *operations)
+{
+    size_t i = 0;
+    skip_spaces(fen, i);
+
+    for (auto &row : game.board)
+        for (auto &piece : row)
+            piece = piece_t();
+    game.material = 0;
+    unsigned white_kings = 0, black_kings = 0;
+
+    // piece placement, from rank 8 down to rank 1
+    for (int y = 8; y >= 1; y--)
+    {
+        int x = 1;
+        while (x <= 8)
+        {
+            if (i == fen.size())
+                return false;
+            char c = fen[i++];
+            if (c >= '1' && c <= '8')
+            {
+                x += c - '0';
+                continue;
+            }
+            piece_type type = type_from_letter(c);
+            if (type == piece_type::invalid)
+                return false;
+            bool white = c < 'a';
+            if (type == piece_type::pawn && (y == 1 || y == 8))
+                return false;
+            if (type == piece_type::king)
+            {
+                (white ? white_kings : black_kings)++;
+                (white ? game.white_king : game.black_king) = coordinate_t(x, y);
+            }
+            // castling rights are applied below, until then nothing may castle
+            game.board[x - 1][y - 1] = piece_t(x, y, white, type, true);
+            game.material += material_unit(white, type);
+            x++;
+        }
+        if (x != 9)
+            return false;
+        if (y > 1 && (i == fen.size() || fen[i++] != '/'))
+            return false;
+    }
+    if (white_kings != 1 || black_kings != 1)
+        return false;
+
+    // side to move
+    if (!skip_spaces(fen, i) || i == fen.size())
+        return false;
+    if (fen[i] == 'w')
+        game.white_turn = true;
+    else if (fen[i] == 'b')
+        game.white_turn = false;
+    else
+        return false;
+    i++;
+
+    // kings side by side, or the side that just moved left in check, cannot
+    // arise in a game and the search, probes and suites assume neither
+    if (std::abs(game.white_king.x - game.black_king.x) <= 1 && std::abs(game.white_king.y - game.black_king.y) <= 1)
+        return false;
+    if (king_attacked(game, !game.white_turn))
+        return false;
+
+    // castling rights become unmoved kings and rooks
+    if (!skip_spaces(fen, i) || i == fen.size())
+        return false;
+    if (fen[i] == '-')
+        i++;
+    else
+    {
+        unsigned seen = 0;
+        while (i < fen.size() && !is_space(fen[i]))
+        {
+            unsigned right;
+            switch (fen[i++])
+            {
+            case 'K':
+                right = 0;
+                break;
+            case 'Q':
+                right = 1;
+                break;
+            case 'k':
+                right = 2;
+                break;
+            case 'q':
+                right = 3;
+                break;
+            default:
+                return false;
+            }
+            if (seen & (1u << right))
+                return false;
+            seen |= 1u << right;
+
+            uint8_t y = right < 2 ? 1 : 8;
+            uint8_t rook_x = right % 2 ? 1 : 8;
+            bool white = y == 1;
+            piece_t &king = game.board[5 - 1][y - 1];
+            piece_t &rook = game.board[rook_x - 1][y - 1];
+            if (!king.isking() || king.iswhite() != white || !rook.isrook() || rook.iswhite() != white)
+                return false;
+            king = piece_t(5, y, white, piece_type::king);
+            rook = piece_t(rook_x, y, white, piece_type::rook);
+        }
+        if (!seen)
+            return false;
+    }
+
+    // en passant target, stored as the square of the pawn that just advanced
+    if (!skip_spaces(fen, i) || i == fen.size())
+        return false;
+    game.enpassant = {0, 0};
+    if (fen[i] == '-')
+        i++;
+    else
+    {
+        if (fen.size() - i < 2)
+            return false;
+        int x = fen[i] - 'a' + 1;
+        int y = fen[i + 1] - '0';
+        i += 2;
+        if (x < 1 || x > 8 || y != (game.white_turn ? 6 : 3))
+            return false;
+        uint8_t pawn_y = game.white_turn ? 5 : 4;
+        piece_t pawn = game.get(x, pawn_y);
+        if (!pawn.ispawn() || pawn.iswhite() == game.white_turn || game.get(x, y))
+            return false;
+        game.enpassant = coordinate_t(x, pawn_y);
+    }
+
+    // move counters, which EPD and some FEN writers leave out
+    game.halfmove_clock = 0;
+    game.fullmove_number = 1;
+    size_t fields_end = i;
+    unsigned halfmove, fullmove;
+    if (skip_spaces(fen, i) && parse_number(fen, i, halfmove) && skip_spaces(fen, i) && parse_number(fen, i, fullmove))
+    {
+        game.halfmove_clock = halfmove;
+        game.fullmove_number = fullmove ? fullmove : 1;
+    }
+    else
+        i = fields_end;
+    if (i < fen.size() && !is_space(fen[i]) && fen[i] != '\r' && fen[i] != '\n')
+        return false;
+
+    while (i < fen.size() && is_space(fen[i]))
+        i++;
+    if (operations)
+        *operations = fen.substr(i);
+    else
+    {
+        while (i < fen.size() && (fen[i] == '\r' || fen[i] == '\n'))
+            i++;
+        if (i != fen.size())
+            return false;
+    }
+
+    game.moves.clear();
+    game.promote = false;
+    game.white_check = game.black_check = false;
+    game.current_piece = piece_t();
+    return true;
+}
+
+size_t game_t::to_fen(char *out, size_t size) const
+{
+    // longest possible FEN is well under this, checking once keeps the writer simple
+    char buffer[128];
+    size_t n = 0;
+    for (int y = 8; y >= 1; y--)
+    {
+        int empty = 0;
+        for (int x = 1; x <= 8; x++)
+        {
+            piece_t piece = board[x - 1][y - 1];
+            if (piece.isinvalid())
+            {
+                empty++;
+                continue;
+            }
+            if (empty)
+                buffer[n++] = char('0' + empty);
+            empty = 0;
+            char c = letters[int(piece.get_type())];
+            buffer[n++] = piece.iswhite() ? char(c - 0x20) : c;
+        }
+        if (empty)
+            buffer[n++] = char('0' + empty);
+        if (y > 1)
+            buffer[n++] = '/';
+    }
+    buffer[n++] = ' ';
+    buffer[n++] = white_turn ? 'w' : 'b';
+    buffer[n++] = ' ';
+
+    unsigned rights = castling_rights();
+    if (!rights)
+        buffer[n++] = '-';
+    for (unsigned right = 0; right < 4; right++)
+        if (rights & (1u << right))
+            buffer[n++] = "KQkq"[right];
+    buffer[n++] = ' ';
+
+    if (enpassant == coordinate_t{0, 0})
+        buffer[n++] = '-';
+    else
+    {
+        buffer[n++] = char('a' + enpassant.x - 1);
+        buffer[n++] = char('0' + (white_turn ? enpassant.y + 1 : enpassant.y - 1));
+    }
+
+    n = write_number(buffer, n, halfmove_clock);
+    n = write_number(buffer, n, fullmove_number);
+    if (n + 1 > size)
+        return 0;
+    std::copy(buffer, buffer + n, out);
+    out[n] = '\0';
+    return n;
+}
+
+std::string game_t::to_fen() const
+{
+    char buffer[128];
+    return std::string(buffer, to_fen(buffer, sizeof(buffer)));
+}
@@ -0,0 +1,401 @@
+#include <algorithm>
+#include <cstring>
+#include <queue>
+#include "book.hpp"
+#include "game_db.hpp"
+
+namespace
+{
+    constexpr char magic[8] = {'C', 'H', 'G', 'D', 'B', '0', '0', '1'};
+    constexpr size_t header_size = 64;
+    // order of the section offsets in the header
+    enum section_t
+    {
+        keys_section,
+        postings_section,
+        offsets_section,
+        data_section,
+    };
+
+    struct db_key_t
+    {
+        uint64_t key;
+        uint64_t postings;
+    };
+
+    bool posting_less(const db_posting_t &a, const db_posting_t &b)
+    {
+        return a.key != b.key ? a.key < b.key : a.game < b.game;
+    }
+
+    void put_varint(std::string &out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out += char(value | 0x80);
+            value >>= 7;
+        }
+        out += char(value);
+    }
+
+    bool get_varint(const unsigned char *&p, const unsigned char *end, uint64_t &value)
+    {
+        value = 0;
+        for (int shift = 0; p < end && shift < 64; shift += 7)
+        {
+            unsigned char byte = *p++;
+            value |= uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return true;
+        }
+        return false;
+    }
+
+    // buffered reader over one sorted run
+    struct run_reader_t
+    {
+        FILE *file = nullptr;
+        std::vector<db_posting_t> buffer;
+        size_t next = 0;
+
+        bool read(db_posting_t &posting)
+        {
+            if (next == buffer.size())
+            {
+                buffer.resize(buffer.capacity());
+                buffer.resize(fread(buffer.data(), sizeof(db_posting_t), buffer.size(), file));
+                next = 0;
+                if (buffer.empty())
+                    return false;
+            }
+            posting = buffer[next++];
+            return true;
+        }
+    };
+
+    // turns the sorted (key, game) stream into the keys and postings sections
+    struct index_writer_t
+    {
+        FILE *keys = nullptr;
+        FILE *postings = nullptr;
+        uint64_t key = 0;
+        std::vector<uint32_t> games;
+        uint64_t postings_size = 0;
+        uint64_t count = 0;
+        std::string bytes;
+
+        bool put(const db_posting_t &posting)
+        {
+            bool ok = true;
+            if (!games.empty() && posting.key != key)
+                ok = flush();
+            key = posting.key;
+            games.push_back(posting.game);
+            return ok;
+        }
+
+        bool flush()
+        {
+            if (games.empty())
+                return true;
+            db_key_t entry{key, postings_size};
+            bytes.clear();
+            put_varint(bytes, games.size());
+            uint32_t previous = 0;
+            for (uint32_t game : games)
+            {
+                put_varint(bytes, game - previous);
+                previous = game;
+            }
+            games.clear();
+            postings_size += bytes.size();
+            count++;
+            return fwrite(&entry, sizeof(entry), 1, keys) == 1 &&
+                   fwrite(bytes.data(), 1, bytes.size(), postings) == bytes.size();
+        }
+    };
+
+    std::string run_path(const std::string &path, size_t run)
+    {
+        return path + ".run" + std::to_string(run);
+    }
+
+    // appends the whole of `from` to `to`
+    bool copy_file(const std::string &from, FILE *to)
+    {
+        FILE *in = fopen(from.c_str(), "rb");
+        if (!in)
+            return false;
+        std::vector<char> chunk(1 << 20);
+        bool ok = true;
+        size_t read;
+        while ((read = fread(chunk.data(), 1, chunk.size(), in)) > 0)
+            ok = fwrite(chunk.data(), 1, read, to) == read && ok;
+        return fclose(in) == 0 && ok;
+    }
+}
+
+game_database_builder::game_database_builder(std::string path, size_t memory_bytes)
+    : path(std::move(path)), capacity(std::max<size_t>(memory_bytes / sizeof(db_posting_t), 1024))
+{
+    buffer.reserve(capacity);
+    data = fopen((this->path + ".data").c_str(), "wb");
+    failed = !data;
+}
+
+game_database_builder::~game_database_builder()
+{
+    if (data)
+        fclose(data);
+    for (size_t run = 0; run < run_count; run++)
+        remove(run_path(path, run).c_str());
+    for (const char *suffix : {".data", ".keys", ".postings"})
+        remove((path + suffix).c_str());
+}
+
+bool game_database_builder::add(const pgn_record_t &record)
+{
+    if (failed)
+        return false;
+    // a start position that does not parse cannot be replayed, skip the game
+    game_t game;
+    std::string_view fen = record.game.tag("FEN");
+    if (!fen.empty() && !game_t::from_fen(fen, game))
+        return true;
+    uint32_t id = uint32_t(offsets.size());
+    offsets.push_back(data_size);
+
+    std::string bytes, tags;
+    for (const pgn_tag_t &tag : record.game.tags)
+    {
+        tags.append(tag.name);
+        tags += '\0';
+        tags.append(tag.value);
+        tags += '\0';
+    }
+    put_varint(bytes, tags.size());
+    bytes += tags;
+    put_varint(bytes, record.moves.size());
+
+    for (move_t move : record.moves)
+    {
+        uint16_t encoded = encode_book_move(game, move);
+        bytes += char(encoded & 0xff);
+        bytes += char(encoded >> 8);
+        game.play(move);
+    }
+    data_size += bytes.size();
+    if (fwrite(bytes.data(), 1, bytes.size(), data) != bytes.size())
+        return !(failed = true);
+
+    // a position reached twice in one game is indexed once
+    std::vector<uint64_t> keys = record.keys;
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    for (uint64_t key : keys)
+    {
+        buffer.push_back({key, id});
+        if (buffer.size() == capacity)
+            spill();
+    }
+    return !failed;
+}
+
+bool game_database_builder::spill()
+{
+    std::sort(buffer.begin(), buffer.end(), posting_less);
+    FILE *file = fopen(run_path(path, run_count).c_str(), "wb");
+    if (!file)
+        return !(failed = true);
+    run_count++;
+    if (fwrite(buffer.data(), sizeof(db_posting_t), buffer.size(), file) != buffer.size())
+        failed = true;
+    if (fclose(file))
+        failed = true;
+    buffer.clear();
+    return !failed;
+}
+
+bool game_database_builder::finish()
+{
+    std::sort(buffer.begin(), buffer.end(), posting_less);
+    if (run_count && !buffer.empty())
+        spill();
+    if (data && fclose(data))
+        failed = true;
+    data = nullptr;
+    if (failed)
+        return false;
+
+    index_writer_t writer;
+    writer.keys = fopen((path + ".keys").c_str(), "wb");
+    writer.postings = fopen((path + ".postings").c_str(), "wb");
+    bool ok = writer.keys && writer.postings;
+    if (ok && !run_count)
+    {
+        for (const db_posting_t &posting : buffer)
+            ok = writer.put(posting) && ok;
+    }
+    else if (ok)
+    {
+        // k-way merge, each run gets an equal share of the memory budget
+        std::vector<run_reader_t> readers(run_count);
+        size_t share = std::max<size_t>(capacity / run_count, 256);
+        using head_t = std::pair<db_posting_t, size_t>;
+        auto greater = [](const head_t &a, const head_t &b)
+        { return posting_less(b.first, a.first); };
+        std::priority_queue<head_t, std::vector<head_t>, decltype(greater)> heads(greater);
+        buffer = {};
+        for (size_t run = 0; run < run_count; run++)
+        {
+            readers[run].file = fopen(run_path(path, run).c_str(), "rb");
+            readers[run].buffer.reserve(share);
+            db_posting_t posting;
+            if (!readers[run].file)
+                ok = false;
+            else if (readers[run].read(posting))
+                heads.push({posting, run});
+        }
+        while (ok && !heads.empty())
+        {
+            head_t head = heads.top();
+            heads.pop();
+            ok = writer.put(head.first);
+            if (readers[head.second].read(head.first))
+                heads.push(head);
+        }
+        for (run_reader_t &reader : readers)
+            if (reader.file)
+                fclose(reader.file);
+    }
+    ok = writer.flush() && ok;
+    if (writer.keys)
+        ok = fclose(writer.keys) == 0 && ok;
+    if (writer.postings)
+        ok = fclose(writer.postings) == 0 && ok;
+    if (!ok)
+        return false;
+    keys_written = writer.count;
+
+    // the offsets are read in place, keep them 8 byte aligned
+    uint64_t padding = (8 - writer.postings_size % 8) % 8;
+    uint64_t header[8] = {};
+    memcpy(header, magic, sizeof(magic));
+    header[1] = offsets.size();
+    header[2] = writer.count;
+    header[3 + keys_section] = header_size;
+    header[3 + postings_section] = header_size + writer.count * sizeof(db_key_t);
+    header[3 + offsets_section] = header[3 + postings_section] + writer.postings_size + padding;
+    header[3 + data_section] = header[3 + offsets_section] + (offsets.size() + 1) * sizeof(uint64_t);
+    offsets.push_back(data_size);
+
+    FILE *out = fopen(path.c_str(), "wb");
+    if (!out)
+        return false;
+    const uint64_t zero = 0;
+    ok = fwrite(header, sizeof(header), 1, out) == 1;
+    ok = copy_file(path + ".keys", out) && ok;
+    ok = copy_file(path + ".postings", out) && ok;
+    ok = fwrite(&zero, 1, padding, out) == padding && ok;
+    ok = fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), out) == offsets.size() && ok;
+    ok = copy_file(path + ".data", out) && ok;
+    offsets.pop_back();
+    return fclose(out) == 0 && ok;
+}
+
+std::string_view db_game_t::tag(std::string_view name) const
+{
+    for (const auto &t : tags)
+        if (t.first == name)
+            return t.second;
+    return {};
+}
+
+game_database::game_database(const char *path) : file(path)
+{
+    if (!file.is_open() || file.length() < header_size || memcmp(file.bytes(), magic, sizeof(magic)))
+        return;
+    uint64_t header[8];
+    memcpy(header, file.bytes(), sizeof(header));
+    game_count = header[1];
+    key_count = header[2];
+    std::copy(header + 3, header + 7, sections);
+    valid = sections[keys_section] == header_size &&
+            sections[postings_section] == header_size + key_count * sizeof(db_key_t) &&
+            sections[offsets_section] >= sections[postings_section] && sections[offsets_section] % 8 == 0 &&
+            sections[data_section] == sections[offsets_section] + (game_count + 1) * sizeof(uint64_t) &&
+            sections[data_section] <= file.length();
+    if (valid)
+    {
+        uint64_t end;
+        memcpy(&end, file.bytes() + sections[offsets_section] + game_count * sizeof(uint64_t), sizeof(end));
+        valid = sections[data_section] + end == file.length();
+    }
+}
+
+size_t game_database::find(uint64_t key, std::vector<uint32_t> &ids) const
+{
+    ids.clear();
+    if (!valid)
+        return 0;
+    const db_key_t *first = reinterpret_cast<const db_key_t *>(file.bytes() + sections[keys_section]);
+    const db_key_t *last = first + key_count;
+    const db_key_t *found = std::lower_bound(first, last, key, [](const db_key_t &e, uint64_t k)
+                                             { return e.key < k; });
+    if (found == last || found->key != key)
+        return 0;
+
+    const unsigned char *p = file.bytes() + sections[postings_section] + found->postings;
+    const unsigned char *end = file.bytes() + sections[offsets_section];
+    uint64_t count, delta, game = 0;
+    if (!get_varint(p, end, count))
+        return 0;
+    ids.reserve(count);
+    for (uint64_t i = 0; i < count && get_varint(p, end, delta); i++)
+        ids.push_back(uint32_t(game += delta));
+    return ids.size();
+}
+
+bool game_database::game(uint32_t id, db_game_t &out) const
+{
+    out.tags.clear();
+    out.moves.clear();
+    out.start = game_t();
+    if (!valid || id >= game_count)
+        return false;
+    uint64_t range[2];
+    memcpy(range, file.bytes() + sections[offsets_section] + id * sizeof(uint64_t), sizeof(range));
+    const unsigned char *p = file.bytes() + sections[data_section] + range[0];
+    const unsigned char *end = file.bytes() + sections[data_section] + range[1];
+
+    uint64_t tags_size, moves;
+    if (!get_varint(p, end, tags_size) || tags_size > uint64_t(end - p))
+        return false;
+    std::string_view tags(reinterpret_cast<const char *>(p), tags_size);
+    p += tags_size;
+    while (!tags.empty())
+    {
+        size_t name_end = tags.find('\0');
+        size_t value_end = tags.find('\0', name_end + 1);
+        if (value_end == std::string_view::npos)
+            return false;
+        out.tags.emplace_back(tags.substr(0, name_end), tags.substr(name_end + 1, value_end - name_end - 1));
+        tags.remove_prefix(value_end + 1);
+    }
+
+    std::string_view fen = out.tag("FEN");
+    if (!fen.empty() && !game_t::from_fen(fen, out.start))
+        return false;
+    if (!get_varint(p, end, moves) || moves * 2 != uint64_t(end - p))
+        return false;
+    game_t game = out.start;
+    for (; p < end; p += 2)
+    {
+        move_t move = decode_book_move(game, uint16_t(p[0] | p[1] << 8));
+        if (move.isnull())
+            return false;
+        out.moves.push_back(move);
+        game.play(move);
+    }
+    return true;
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "mapped_file.hpp"
+#include "pgn_import.hpp"
+
+// A game database file holds every game compressed to two bytes a move (the
+// Polyglot encoding, see encode_book_move) and an inverted index from
+// game_t::hash to the games that reached the position:
+//
+//   header     64 bytes, "CHGDB001" then the counts and section offsets
+//   keys       {key, offset into postings} sorted by key
+//   postings   per key a varint count and the game ids as varint deltas
+//   offsets    where each game starts in data, one more for the end
+//   data       per game the tags as name\0value\0 pairs, then the moves
+
+// one (position, game) pair while building
+struct db_posting_t
+{
+    uint64_t key;
+    uint32_t game;
+};
+
+// Stores games as they are added and collects the index in a buffer of
+// bounded size. Full buffers are sorted and spilled to run files next to the
+// output, finish() merges them and puts the file together.
+class game_database_builder
+{
+public:
+    game_database_builder(std::string path, size_t memory_bytes);
+    ~game_database_builder();
+    game_database_builder(const game_database_builder &) = delete;
+    game_database_builder &operator=(const game_database_builder &) = delete;
+
+    // games that did not replay whole are kept up to the last resolved move
+    bool add(const pgn_record_t &record);
+    // false if a file could not be written
+    bool finish();
+
+    uint64_t games() const { return offsets.size(); }
+    uint64_t positions() const { return keys_written; }
+    size_t runs() const { return run_count; }
+
+private:
+    bool spill();
+
+    std::string path;
+    std::vector<db_posting_t> buffer;
+    size_t capacity;
+    size_t run_count = 0;
+    FILE *data = nullptr;
+    uint64_t data_size = 0;
+    std::vector<uint64_t> offsets;
+    uint64_t keys_written = 0;
+    bool failed = false;
+};
+
+struct db_game_t
+{
+    std::vector<std::pair<std::string, std::string>> tags;
+    // position before the first move, from the FEN tag if there is one
+    game_t start;
+    std::vector<move_t> moves;
+
+    std::string_view tag(std::string_view name) const;
+};
+
+// Read only view of a database file, safe to query from several threads
+class game_database
+{
+public:
+    game_database() = default;
+    explicit game_database(const char *path);
+
+    bool is_open() const { return valid; }
+    uint64_t games() const { return game_count; }
+    uint64_t positions() const { return key_count; }
+    // ids of the games that reached the position, ascending. Returns how many.
+    size_t find(uint64_t key, std::vector<uint32_t> &ids) const;
+    // decodes a game, false if the id or the stored game is bad
+    bool game(uint32_t id, db_game_t &out) const;
+
+private:
+    mapped_file file;
+    uint64_t game_count = 0;
+    uint64_t key_count = 0;
+    uint64_t sections[4] = {};
+    bool valid = false;
+};
@@ -0,0 +1,130 @@
+#include "kpk.hpp"
+
+namespace
+{
+    constexpr uint64_t bit(int square) { return uint64_t(1) << square; }
+    constexpr uint64_t file_a = 0x0101010101010101ull;
+    constexpr uint64_t file_h = file_a << 7;
+    constexpr int steps[8][2] = {{1, 0}, {1, 1}, {0, 1}, {-1, 1}, {-1, 0}, {-1, -1}, {0, -1}, {1, -1}};
+
+    // squares from which a step of (dx, dy) lands in `to`
+    constexpr uint64_t step_from(uint64_t to, int dx, int dy)
+    {
+        int shift = dy * 8 + dx;
+        uint64_t from = shift > 0 ? to >> shift : to << -shift;
+        if (dx > 0)
+            from &= ~file_h;
+        if (dx < 0)
+            from &= ~file_a;
+        return from;
+    }
+
+    constexpr uint64_t king_attacks(int square)
+    {
+        uint64_t attacks = 0;
+        for (const auto &s : steps)
+            attacks |= step_from(bit(square), -s[0], -s[1]);
+        return attacks;
+    }
+
+    constexpr uint64_t pawn_attacks(int square)
+    {
+        return step_from(bit(square), -1, -1) | step_from(bit(square), 1, -1);
+    }
+
+    // pawns on files a-d and ranks 2-7
+    constexpr int pawn_index(int square) { return (square / 8 - 1) * 4 + square % 8; }
+
+    struct kpk_t
+    {
+        // indexed by pawn and white king, the black king squares where white
+        // wins with white or with black to move
+        uint64_t white_to_move[24][64]{};
+        uint64_t black_to_move[24][64]{};
+    };
+
+    // Starts from the positions where the pawn promotes safely and grows the
+    // wins one move at a time until nothing changes. Pawns further up are
+    // settled first since pushes only lead there. Each step works on every
+    // black king square at once.
+    constexpr kpk_t generate()
+    {
+        kpk_t kpk;
+        uint64_t kings[64]{};
+        for (int square = 0; square < 64; square++)
+            kings[square] = king_attacks(square);
+
+        for (int rank = 6; rank >= 1; rank--)
+        {
+            bool changed = true;
+            while (changed)
+            {
+                changed = false;
+                for (int file = 0; file < 4; file++)
+                    for (int wk = 0; wk < 64; wk++)
+                    {
+                        int pawn = rank * 8 + file, p = pawn_index(pawn);
+                        if (wk == pawn)
+                            continue;
+                        uint64_t pawn_bit = bit(pawn);
+
+                        // black wins nothing by moving: every step must land
+                        // on a white win or be impossible, and there must be
+                        // a step or a check (stalemate draws)
+                        bool defended = kings[wk] & pawn_bit;
+                        uint64_t blocked = kings[wk] | bit(wk) | pawn_attacks(pawn) | (defended ? pawn_bit : 0);
+                        uint64_t good = kpk.white_to_move[p][wk] | blocked;
+                        uint64_t all_good = ~uint64_t(0), can_move = 0;
+                        for (const auto &s : steps)
+                        {
+                            uint64_t edge = ~step_from(~uint64_t(0), s[0], s[1]);
+                            all_good &= step_from(good, s[0], s[1]) | edge;
+                            can_move |= step_from(~blocked, s[0], s[1]);
+                        }
+                        uint64_t legal_black = ~(bit(wk) | pawn_bit | kings[wk]);
+                        uint64_t black = legal_black & all_good & (can_move | pawn_attacks(pawn));
+
+                        // white needs one move to a black-to-move win
+                        uint64_t white = 0;
+                        for (const auto &s : steps)
+                        {
+                            int x = wk % 8 + s[0], y = wk / 8 + s[1];
+                            if (x < 0 || x > 7 || y < 0 || y > 7 || y * 8 + x == pawn)
+                                continue;
+                            white |= kpk.black_to_move[p][y * 8 + x];
+                        }
+                        int push = pawn + 8;
+                        if (push != wk && rank < 6)
+                            white |= kpk.black_to_move[pawn_index(push)][wk];
+                        if (push != wk && rank == 1 && push + 8 != wk)
+                            white |= kpk.black_to_move[pawn_index(push + 8)][wk] & ~bit(push);
+                        // promoting wins unless the new queen is taken at once
+                        if (push != wk && rank == 6)
+                            white |= (kings[wk] & bit(push)) ? ~bit(push) : ~(bit(push) | kings[push]);
+                        white &= ~(bit(wk) | pawn_bit | kings[wk] | pawn_attacks(pawn));
+
+                        if (black != kpk.black_to_move[p][wk] || white != kpk.white_to_move[p][wk])
+                            changed = true;
+                        kpk.black_to_move[p][wk] = black;
+                        kpk.white_to_move[p][wk] = white;
+                    }
+            }
+        }
+        return kpk;
+    }
+
+    constexpr kpk_t kpk = generate();
+}
+
+bool kpk_wins(unsigned strong_king, unsigned pawn, unsigned weak_king, bool strong_to_move)
+{
+    // the table only holds pawns on files a-d
+    if (pawn % 8 >= 4)
+    {
+        strong_king ^= 7;
+        pawn ^= 7;
+        weak_king ^= 7;
+    }
+    const uint64_t(&wins)[24][64] = strong_to_move ? kpk.white_to_move : kpk.black_to_move;
+    return wins[pawn_index(pawn)][strong_king] & bit(weak_king);
+}
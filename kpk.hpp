@@ -0,0 +1,7 @@
+#pragma once
+#include <cstdint>
+
+// King and pawn against king, worked out while compiling. Squares are 0 to
+// 63, a1 = 0, seen from the side with the pawn: the pawn moves up the board
+// (for a black pawn pass every square ^ 56). True if the pawn's side wins.
+bool kpk_wins(unsigned strong_king, unsigned pawn, unsigned weak_king, bool strong_to_move);
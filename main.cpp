@@ -1,9 +1,16 @@
 #include <iostream>
 #include <cstdlib>
 #include <cassert>
+#include <cstring>
 #include <array>
 #include "rendering.hpp"
+#include "sprites.hpp"
 #include "chess.hpp"
+#include "analysis.hpp"
+#include "engine.hpp"
+#include "bench.hpp"
+#include "trace.hpp"
+#include "perf_overlay.hpp"
 
 #include <imgui/imgui.h>
 #include <imgui_impl_glfw.h>
@@ -15,10 +22,33 @@
 constexpr int window_width = 800;
 constexpr int window_height = window_width;
 
+struct gui_state_t
+{
+    game_t game;
+    analysis_worker analysis{glfwPostEmptyEvent};
+    // generation of the position last handed to the worker
+    uint64_t generation = 0;
+
+    engine_worker engine{glfwPostEmptyEvent};
+    bool engine_plays_black = false;
+    // generation of the go() the engine is answering, 0 when not asked yet
+    uint64_t engine_generation = 0;
+
+    void position_changed()
+    {
+        game.moves = {};
+        game.white_check = game.black_check = false;
+        generation = analysis.submit(game);
+        engine_generation = 0;
+    }
+    bool engine_turn() const { return engine_plays_black && !game.white_turn && !game.promote; }
+};
+
 void mouse_button_callback(GLFWwindow *window, int button, int action, int mods)
 {
-    game_t *game = (game_t *)glfwGetWindowUserPointer(window);
-    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS && !game->promote)
+    gui_state_t *state = (gui_state_t *)glfwGetWindowUserPointer(window);
+    game_t *game = &state->game;
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS && !game->promote && !state->engine_turn())
     {
         double xpos, ypos;
         glfwGetCursorPos(window, &xpos, &ypos);
@@ -43,25 +73,21 @@ void mouse_button_callback(GLFWwindow *window, int button, int action, int mods)
                 game->promote = false;
 
             game->move(x, y);
-            game->black_check = game->in_check(false);
-            game->white_check = game->in_check(true);
-            game->moves = {};
-
-            if (game->in_check_mate(!game->white_turn))
-            {
-                printf("CHECKMATE %s WIN!\n", game->white_turn ? "WHITE" : "BLACK");
-                fflush(0);
-            }
             game->white_turn = !game->white_turn;
+            state->position_changed();
             return;
         }
+        // until the worker has caught up no moves are offered
+        const analysis_t &analysis = state->analysis.latest();
+        if (analysis.generation != state->generation)
+            return;
         if (game->white_turn)
             game->set_current_piece(game->get_white(x, y));
         else
             game->set_current_piece(game->get_black(x, y));
         if (game->get_current_piece())
         {
-            game->moves = game->get_current_piece().available_moves(*game, game->white_turn, game->enpassant);
+            game->moves = analysis.moves_from(game->get_current_piece().get_position());
             return;
         }
         game->moves = {};
@@ -82,8 +108,20 @@ void APIENTRY glDebugOutput(GLenum source,
                             const char *message,
                             const void *userParam);
 
-int main()
+// chess [--book book.bin] [--tablebases directory] [--trace trace.json]
+int main(int argc, char **argv)
 {
+    // chess --bench [depth] prints the search signature and speed without opening a window
+    if (argc >= 2 && strcmp(argv[1], "--bench") == 0)
+    {
+        int depth = argc >= 3 ? std::min(std::max(atoi(argv[2]), 1), max_ply - 1) : bench_depth;
+        bench_result_t result = run_bench(depth);
+        printf("bench %llu nodes  %llu nps\n", (unsigned long long)result.nodes, (unsigned long long)result.nps());
+        return 0;
+    }
+    int64_t launched = steady_ns();
+    // decodes the sprites while the window and context are created
+    start_loading_sprites();
 
 #ifndef NDEBUG
     glfwSetErrorCallback(error_callback);
@@ -103,7 +141,7 @@ int main()
     if (!window)
     {
         glfwTerminate();
-        exit(EXIT_FAILURE);
+        return 1;
     }
     glfwSetMouseButtonCallback(window, mouse_button_callback);
 
@@ -121,122 +159,212 @@ int main()
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    constexpr int board_width = 8, board_height = 8;
-
-    std::array<uint8_t, 4> brown{0xd2, 0x69, 0x1e, 0xff};
-    std::array<uint8_t, 4> white{0xff, 0xff, 0xff, 0xff};
-    std::array<uint8_t, 4> blue_transparent{0x05, 0x10, 0xff, 0x88};
-    std::array<uint8_t, 4> red_transparent{0xff, 0x00, 0x00, 0x88};
-    std::array<std::array<std::array<uint8_t, 4>, board_width>, board_height> pixels;
-    for (unsigned j = 0; j < board_height; j++)
-        for (unsigned i = 0; i < board_width; i++)
+    const char *trace_path = nullptr;
+    // everything holding GL objects or worker threads goes before the window
+    // and GLFW, the workers call glfwPostEmptyEvent until they are joined
+    {
+        // the squares and pieces, drawn again only when the position changes
+        cached_batch board(window_width, window_height, 0.25f, sprites().atlas);
+        // move hints and checks over them, from the same atlas
+        square_batch highlights(0.25f, sprites().atlas);
+        gpu_timer render_timer;
+        gui_state_t state;
+        for (int i = 1; i + 1 < argc; i += 2)
         {
-            pixels[j][i] = (i + j) % 2 ? brown : white;
+            if (strcmp(argv[i], "--book") == 0 && !state.engine.open_book(argv[i + 1]))
+                fprintf(stderr, "Error: %s is not a Polyglot book\n", argv[i + 1]);
+            else if (strcmp(argv[i], "--tablebases") == 0 && !state.engine.open_tablebases(argv[i + 1]))
+                fprintf(stderr, "Error: no tables in %s\n", argv[i + 1]);
+            else if (strcmp(argv[i], "--trace") == 0)
+                trace_path = argv[i + 1];
         }
+        game_t &game = state.game;
+        state.position_changed();
+        glfwSetWindowUserPointer(window, &state);
+
+        IMGUI_CHECKVERSION();
+        ImGui::CreateContext();
+        ImGuiIO &io = ImGui::GetIO();
+        (void)io;
+        ImGui::StyleColorsDark();
+
+        ImGui_ImplGlfw_InitForOpenGL(window, true);
+        ImGui_ImplOpenGL3_Init("#version 330");
+
+        uint64_t reported_generation = 0;
+        perf_overlay overlay;
+        bool first_frame = true;
+        while (!glfwWindowShouldClose(window))
+        {
+            // the first frame is drawn without waiting for an event
+            if (first_frame)
+                glfwPollEvents();
+            else
+                glfwWaitEvents();
+            overlay.begin_frame();
 
-    drawing_params board = setup_square(pixels.data(), board_width, board_height, 2.f, GL_NEAREST);
-    drawing_params blue_square = setup_square(blue_transparent.data(), 1, 1, 0.25f, GL_NEAREST);
-    drawing_params red_square = setup_square(red_transparent.data(), 1, 1, 0.25f, GL_NEAREST);
-    game_t game;
-    glfwSetWindowUserPointer(window, &game);
-
-    IMGUI_CHECKVERSION();
-    ImGui::CreateContext();
-    ImGuiIO &io = ImGui::GetIO();
-    (void)io;
-    ImGui::StyleColorsDark();
-
-    ImGui_ImplGlfw_InitForOpenGL(window, true);
-    ImGui_ImplOpenGL3_Init("#version 330");
+            const analysis_t &analysis = state.analysis.latest();
+            overlay.analysed(analysis);
+            bool analysed = analysis.generation == state.generation;
+            if (analysed)
+            {
+                game.white_check = analysis.white_check;
+                game.black_check = analysis.black_check;
+                if (analysis.check_mate && reported_generation != analysis.generation)
+                {
+                    printf("CHECKMATE %s WIN!\n", game.white_turn ? "BLACK" : "WHITE");
+                    fflush(0);
+                    reported_generation = analysis.generation;
+                }
+            }
 
-    while (!glfwWindowShouldClose(window))
-    {
-        glfwWaitEvents();
+            const engine_reply_t &reply = state.engine.latest();
+            if (state.engine_turn() && analysed && !analysis.check_mate)
+            {
+                if (!state.engine_generation)
+                    state.engine_generation = state.engine.go(game);
+                else if (reply.generation == state.engine_generation && !reply.move.isnull())
+                {
+                    game.play(reply.move);
+                    state.position_changed();
+                }
+            }
 
-        ImGui_ImplOpenGL3_NewFrame();
-        ImGui_ImplGlfw_NewFrame();
-        ImGui::NewFrame();
-        auto flags = ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoResize;
-        if (game.promote)
-        {
-            ImGui::Begin(game.white_turn ? "White pawn promotion" : "Black pawn promotion", nullptr, flags);
-            int e = -1;
-            ImGui::RadioButton("Queen", &e, 0);
-            ImGui::SameLine();
-            ImGui::RadioButton("Rook", &e, 1);
-            ImGui::SameLine();
-            ImGui::RadioButton("Bishop", &e, 2);
-            ImGui::SameLine();
-            ImGui::RadioButton("Knight", &e, 3);
-            piece_t piece;
-            if (e != -1)
+            ImGui_ImplOpenGL3_NewFrame();
+            ImGui_ImplGlfw_NewFrame();
+            ImGui::NewFrame();
+            if (ImGui::IsKeyPressed(ImGuiKey_F3, false))
+                overlay.visible = !overlay.visible;
+            state.engine.report_progress = overlay.visible;
+            if (overlay.visible)
+                overlay.searched(state.engine.progress());
+            overlay.draw();
+            auto flags = ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoResize;
+            if (game.promote)
             {
-                switch (e)
+                ImGui::Begin(game.white_turn ? "White pawn promotion" : "Black pawn promotion", nullptr, flags);
+                int e = -1;
+                ImGui::RadioButton("Queen", &e, 0);
+                ImGui::SameLine();
+                ImGui::RadioButton("Rook", &e, 1);
+                ImGui::SameLine();
+                ImGui::RadioButton("Bishop", &e, 2);
+                ImGui::SameLine();
+                ImGui::RadioButton("Knight", &e, 3);
+                piece_t piece;
+                if (e != -1)
                 {
-                case 0:
-                    piece = piece_t(game.get_current_piece().get_position().x, game.get_current_piece().get_position().y, game.white_turn, piece_type::queen);
-                    break;
-                case 1:
-                    piece = piece_t(game.get_current_piece().get_position().x, game.get_current_piece().get_position().y, game.white_turn, piece_type::rook);
-                    break;
-                case 2:
-                    piece = piece_t(game.get_current_piece().get_position().x, game.get_current_piece().get_position().y, game.white_turn, piece_type::bishop);
-                    break;
-                case 3:
-                    piece = piece_t(game.get_current_piece().get_position().x, game.get_current_piece().get_position().y, game.white_turn, piece_type::knight);
-                    break;
-                default:
-                    assert(false);
-                    break;
+                    switch (e)
+                    {
+                    case 0:
+                        piece = piece_t(game.get_current_piece().get_position().x, game.get_current_piece().get_position().y, game.white_turn, piece_type::queen);
+                        break;
+                    case 1:
+                        piece = piece_t(game.get_current_piece().get_position().x, game.get_current_piece().get_position().y, game.white_turn, piece_type::rook);
+                        break;
+                    case 2:
+                        piece = piece_t(game.get_current_piece().get_position().x, game.get_current_piece().get_position().y, game.white_turn, piece_type::bishop);
+                        break;
+                    case 3:
+                        piece = piece_t(game.get_current_piece().get_position().x, game.get_current_piece().get_position().y, game.white_turn, piece_type::knight);
+                        break;
+                    default:
+                        assert(false);
+                        break;
+                    }
+
+                    game.get(piece.get_position()) = piece;
+                    game.material += material_unit(game.white_turn, piece.get_type()) - material_unit(game.white_turn, piece_type::pawn);
+                    game.promote = false;
+                    game.white_turn = !game.white_turn;
+                    state.position_changed();
                 }
 
-                game.get(piece.get_position()) = piece;
-                game.promote = false;
-                game.black_check = game.in_check(false);
-                game.white_check = game.in_check(true);
-                game.white_turn = !game.white_turn;
+                ImGui::End();
             }
-
+            ImGui::SetNextWindowCollapsed(true, ImGuiCond_FirstUseEver);
+            ImGui::Begin("Engine", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+            if (ImGui::Checkbox("Play black", &state.engine_plays_black) && !state.engine_plays_black)
+            {
+                state.engine.stop();
+                state.engine_generation = 0;
+            }
+            bool ponder = state.engine.ponder;
+            if (ImGui::Checkbox("Ponder", &ponder))
+                state.engine.ponder = ponder;
+            if (reply.generation && reply.book)
+                ImGui::Text("book move");
+            else if (reply.generation)
+                ImGui::Text("depth %d  score %d  nodes %llu  tb hits %llu%s", reply.info.depth, reply.info.score,
+                            (unsigned long long)reply.info.nodes, (unsigned long long)reply.info.tb_hits,
+                            reply.ponder_hit ? "  (ponder hit)" : "");
             ImGui::End();
-        }
-        if (game.in_check_mate(game.white_turn))
-        {
-            ImGui::Begin(game.white_turn ? "Black wins" : "White wins", nullptr, flags);
 
-            auto windowWidth = ImGui::GetWindowSize().x;
-            auto textWidth = ImGui::CalcTextSize("CHECKMATE").x;
+            if (analysed && analysis.check_mate)
+            {
+                ImGui::Begin(game.white_turn ? "Black wins" : "White wins", nullptr, flags);
 
-            ImGui::SetCursorPosX((windowWidth - textWidth) * 0.5f);
-            ImGui::TextColored({0., 1., 0., 1.}, "CHECKMATE");
-            ImGui::End();
-        }
-        ImGui::Render();
-        glViewport(0, 0, window_width, window_height);
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
-
-        board.draw();
-        game.draw();
-        for (coordinate_t position : game.moves)
-        {
-            blue_square.draw(position.x, position.y);
-        }
-        if (game.white_check)
-            red_square.draw(game.white_king.x, game.white_king.y);
-        if (game.black_check)
-            red_square.draw(game.black_king.x, game.black_king.y);
+                auto windowWidth = ImGui::GetWindowSize().x;
+                auto textWidth = ImGui::CalcTextSize("CHECKMATE").x;
+
+                ImGui::SetCursorPosX((windowWidth - textWidth) * 0.5f);
+                ImGui::TextColored({0., 1., 0., 1.}, "CHECKMATE");
+                ImGui::End();
+            }
+            ImGui::Render();
+            int64_t render_start = steady_ns();
+            if (overlay.visible)
+                render_timer.begin();
+            board.batch.clear();
+            add_board(board.batch, game);
+            bool redrawn = board.update();
+            // the blit covers the whole window, nothing needs clearing
+            glViewport(0, 0, window_width, window_height);
+            board.blit();
+            highlights.clear();
+            for (coordinate_t position : game.moves)
+                highlights.add(position.x, position.y, sprites().blue);
+            if (game.white_check)
+                highlights.add(game.white_king.x, game.white_king.y, sprites().red);
+            if (game.black_check)
+                highlights.add(game.black_king.x, game.black_king.y, sprites().red);
+            highlights.draw();
+            if (overlay.visible)
+            {
+                render_timer.end();
+                overlay.rendered(steady_ns() - render_start, render_timer.last_us(), redrawn);
+            }
 
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-        glfwSwapBuffers(window);
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+            if (overlay.visible)
+            {
+                ImDrawData *data = ImGui::GetDrawData();
+                for (int i = 0; i < data->CmdListsCount; i++)
+                    draw_calls += unsigned(data->CmdLists[i]->CmdBuffer.Size);
+            }
+            overlay.end_frame(draw_calls);
+            draw_calls = 0;
+            glfwSwapBuffers(window);
+            if (first_frame)
+            {
+                int64_t first_frame_ns = steady_ns() - launched;
+                fprintf(stderr, "first frame after %.1f ms, %.2f ms waiting for sprites\n", first_frame_ns / 1e6,
+                        sprites().waited_ns / 1e6);
+                overlay.started(first_frame_ns, sprites().waited_ns);
+                first_frame = false;
+            }
+        }
+        ImGui_ImplOpenGL3_Shutdown();
+        ImGui_ImplGlfw_Shutdown();
+        ImGui::DestroyContext();
     }
-    ImGui_ImplOpenGL3_Shutdown();
-    ImGui_ImplGlfw_Shutdown();
-    ImGui::DestroyContext();
 
     glfwDestroyWindow(window);
 
     glfwTerminate();
-    exit(EXIT_SUCCESS);
+    if (trace_path && !trace_write(trace_path))
+        fprintf(stderr, "Error: could not write a trace to %s, build with -DCHESS_TRACE=ON\n", trace_path);
+    return 0;
 }
 #ifndef NDEBUG
 void APIENTRY glDebugOutput(GLenum source,
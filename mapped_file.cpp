@@ -0,0 +1,57 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include "mapped_file.hpp"
+
+mapped_file::mapped_file(const char *path, bool sequential)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return;
+    struct stat st;
+    if (fstat(fd, &st) == 0)
+    {
+        size = size_t(st.st_size);
+        opened = true;
+        // an empty file has nothing to map
+        if (size)
+        {
+            data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED)
+            {
+                data = nullptr;
+                size = 0;
+                opened = false;
+            }
+            else if (sequential)
+                madvise(data, size, MADV_SEQUENTIAL);
+        }
+    }
+    close(fd);
+}
+
+mapped_file::~mapped_file()
+{
+    if (data)
+        munmap(data, size);
+}
+
+mapped_file::mapped_file(mapped_file &&other) noexcept
+    : data(std::exchange(other.data, nullptr)), size(std::exchange(other.size, 0)), opened(std::exchange(other.opened, false))
+{
+}
+
+mapped_file &mapped_file::operator=(mapped_file &&other) noexcept
+{
+    if (this != &other)
+    {
+        if (data)
+            munmap(data, size);
+        data = std::exchange(other.data, nullptr);
+        size = std::exchange(other.size, 0);
+        opened = std::exchange(other.opened, false);
+    }
+    return *this;
+}
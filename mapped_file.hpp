@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+#include <string_view>
+
+// Read only memory mapping of a whole file
+class mapped_file
+{
+public:
+    mapped_file() = default;
+    // `sequential` hints the kernel to read ahead aggressively
+    explicit mapped_file(const char *path, bool sequential = false);
+    ~mapped_file();
+    mapped_file(mapped_file &&other) noexcept;
+    mapped_file &operator=(mapped_file &&other) noexcept;
+    mapped_file(const mapped_file &) = delete;
+    mapped_file &operator=(const mapped_file &) = delete;
+
+    bool is_open() const { return opened; }
+    const unsigned char *bytes() const { return static_cast<const unsigned char *>(data); }
+    size_t length() const { return size; }
+    std::string_view text() const { return {static_cast<const char *>(data), size}; }
+
+private:
+    void *data = nullptr;
+    size_t size = 0;
+    bool opened = false;
+};
@@ -0,0 +1,289 @@
+#include <algorithm>
+#include <cstdlib>
+#include "kpk.hpp"
+#include "material.hpp"
+
+namespace
+{
+    int distance(coordinate_t a, coordinate_t b)
+    {
+        return std::max(std::abs(int(a.x) - int(b.x)), std::abs(int(a.y) - int(b.y)));
+    }
+
+    // king steps from the four centre squares, 0 to 3
+    int from_centre(coordinate_t c)
+    {
+        return std::max(std::abs(2 * c.x - 9), std::abs(2 * c.y - 9)) / 2;
+    }
+
+    // the first piece of the kind and colour
+    coordinate_t find(const game_t &game, bool white, piece_type type)
+    {
+        for (const auto &row : game.board)
+            for (const auto &piece : row)
+                if (piece.get_type() == type && piece.iswhite() == white)
+                    return piece.get_position();
+        return {0, 0};
+    }
+
+    int non_pawn_material(uint64_t key, bool white)
+    {
+        int value = 0;
+        for (piece_type type : {piece_type::knight, piece_type::bishop, piece_type::rook, piece_type::queen})
+            value += material_count(key, white, type) * piece_values[int(type)];
+        return value;
+    }
+
+    int evaluate_draw(const game_t &, bool) { return 0; }
+
+    // king and pawn against king, exact from the bitbase
+    int evaluate_kpk(const game_t &game, bool strong_white)
+    {
+        coordinate_t strong_king = find(game, strong_white, piece_type::king);
+        coordinate_t weak_king = find(game, !strong_white, piece_type::king);
+        coordinate_t pawn = find(game, strong_white, piece_type::pawn);
+        // squares seen from the pawn's side
+        unsigned flip = strong_white ? 0 : 56;
+        auto square = [&](coordinate_t c)
+        { return unsigned((c.y - 1) * 8 + c.x - 1) ^ flip; };
+        if (!kpk_wins(square(strong_king), square(pawn), square(weak_king), game.white_turn == strong_white))
+            return 0;
+        // further up is closer to queening
+        int score = known_win + int(square(pawn) / 8) * 20;
+        return strong_white ? score : -score;
+    }
+
+    // enough to mate a bare king: drive it to the edge and follow with the own king
+    int evaluate_kxk(const game_t &game, bool strong_white)
+    {
+        coordinate_t strong_king = find(game, strong_white, piece_type::king);
+        coordinate_t weak_king = find(game, !strong_white, piece_type::king);
+        int material = 0;
+        for (const auto &row : game.board)
+            for (const auto &piece : row)
+                if (piece.iswhite() == strong_white)
+                    material += piece_values[int(piece.get_type())];
+        int score = known_win + material + from_centre(weak_king) * 30 + (7 - distance(strong_king, weak_king)) * 10;
+        return strong_white ? score : -score;
+    }
+
+    // bishop and knight mate only in a corner of the bishop's colour
+    int evaluate_kbnk(const game_t &game, bool strong_white)
+    {
+        coordinate_t strong_king = find(game, strong_white, piece_type::king);
+        coordinate_t weak_king = find(game, !strong_white, piece_type::king);
+        coordinate_t bishop = find(game, strong_white, piece_type::bishop);
+        // a1 and h8 are dark, (x + y) even
+        bool dark = (bishop.x + bishop.y) % 2 == 0;
+        coordinate_t corners[2] = {dark ? coordinate_t(1, 1) : coordinate_t(1, 8), dark ? coordinate_t(8, 8) : coordinate_t(8, 1)};
+        int corner = 14;
+        for (coordinate_t c : corners)
+            corner = std::min(corner, std::abs(int(c.x) - int(weak_king.x)) + std::abs(int(c.y) - int(weak_king.y)));
+        int score = known_win + piece_values[int(piece_type::bishop)] + piece_values[int(piece_type::knight)] +
+                    (14 - corner) * 20 + (7 - distance(strong_king, weak_king)) * 10;
+        return strong_white ? score : -score;
+    }
+
+    // rook against pawn: won when the rook's king stops the pawn or the other
+    // king is too far to help it, otherwise the race is counted
+    int evaluate_krkp(const game_t &game, bool strong_white)
+    {
+        coordinate_t strong_king = find(game, strong_white, piece_type::king);
+        coordinate_t weak_king = find(game, !strong_white, piece_type::king);
+        coordinate_t rook = find(game, strong_white, piece_type::rook);
+        coordinate_t pawn = find(game, !strong_white, piece_type::pawn);
+        bool pawn_up = !strong_white;
+        // ranks counted from the pawn's side
+        auto rank = [&](coordinate_t c)
+        { return pawn_up ? int(c.y) : 9 - int(c.y); };
+        coordinate_t queening(pawn.x, pawn_up ? 8 : 1);
+        coordinate_t ahead(pawn.x, pawn_up ? pawn.y + 1 : pawn.y - 1);
+        bool strong_to_move = game.white_turn == strong_white;
+        int rook_value = piece_values[int(piece_type::rook)];
+
+        int score;
+        if (strong_king.x == pawn.x && rank(strong_king) > rank(pawn))
+            score = rook_value - distance(strong_king, pawn);
+        else if (distance(weak_king, pawn) >= 3 + !strong_to_move && distance(weak_king, rook) >= 3)
+            score = rook_value - distance(strong_king, pawn);
+        else if (rank(weak_king) >= 6 && distance(weak_king, pawn) == 1 && rank(strong_king) <= 5 &&
+                 distance(strong_king, pawn) > 2 + strong_to_move)
+            score = 80 - 8 * distance(strong_king, pawn);
+        else
+            score = 200 - 8 * (distance(strong_king, ahead) - distance(weak_king, ahead) - distance(pawn, queening));
+        return strong_white ? score : -score;
+    }
+
+    // bishops of opposite colours and pawns draw often even a pawn or two down
+    int scale_opposite_bishops(const game_t &game)
+    {
+        coordinate_t white = find(game, true, piece_type::bishop), black = find(game, false, piece_type::bishop);
+        if ((white.x + white.y) % 2 == (black.x + black.y) % 2)
+            return 64;
+        int pawns[2] = {};
+        for (const auto &row : game.board)
+            for (const auto &piece : row)
+                if (piece.ispawn())
+                    pawns[piece.iswhite()]++;
+        return std::abs(pawns[1] - pawns[0]) <= 1 ? 16 : 32;
+    }
+
+    struct endgame_t
+    {
+        uint64_t key;
+        int (*evaluate)(const game_t &, bool);
+        bool strong_white;
+    };
+
+    // every material with its own evaluator, for both colours
+    constexpr auto endgames = []
+    {
+        struct named_t
+        {
+            std::string_view white, black;
+            int (*evaluate)(const game_t &, bool);
+        };
+        constexpr named_t named[] = {
+            {"KvK", "KvK", evaluate_draw},
+            {"KNvK", "KvKN", evaluate_draw},
+            {"KBvK", "KvKB", evaluate_draw},
+            {"KNNvK", "KvKNN", evaluate_draw},
+            {"KPvK", "KvKP", evaluate_kpk},
+            {"KBNvK", "KvKBN", evaluate_kbnk},
+            {"KRvKP", "KPvKR", evaluate_krkp},
+        };
+        std::array<endgame_t, 2 * std::size(named)> table{};
+        for (size_t i = 0; i < std::size(named); i++)
+        {
+            table[2 * i] = {material_key(named[i].white), named[i].evaluate, true};
+            table[2 * i + 1] = {material_key(named[i].black), named[i].evaluate, false};
+        }
+        return table;
+    }();
+
+    // values of pieces change with the pawns and the other pieces beside them
+    int imbalance(uint64_t key, bool white)
+    {
+        int pawns = material_count(key, white, piece_type::pawn);
+        int knights = material_count(key, white, piece_type::knight);
+        int bishops = material_count(key, white, piece_type::bishop);
+        int rooks = material_count(key, white, piece_type::rook);
+        int queens = material_count(key, white, piece_type::queen);
+        int value = bishops >= 2 ? 30 : 0;
+        // knights want pawns to hold on to, rooks open files
+        value += knights * (pawns - 5) * 4 + rooks * (5 - pawns) * 6;
+        // two heavy pieces do part of the same work
+        value -= (rooks >= 2 ? 8 : 0) + (queens && rooks ? 8 : 0);
+        return value;
+    }
+
+    // pawns, rooks, bishops, knights, queens
+    constexpr int side_materials = 9 * 3 * 3 * 3 * 2;
+
+    // index of the material of one side among the precomputed ones, -1 if it
+    // is not one of them
+    int side_index(uint64_t side)
+    {
+        unsigned pawns = material_count(side, false, piece_type::pawn);
+        unsigned rooks = material_count(side, false, piece_type::rook);
+        unsigned bishops = material_count(side, false, piece_type::bishop);
+        unsigned knights = material_count(side, false, piece_type::knight);
+        unsigned queens = material_count(side, false, piece_type::queen);
+        if (material_count(side, false, piece_type::king) != 1 || pawns > 8 || rooks > 2 || bishops > 2 || knights > 2 ||
+            queens > 1)
+            return -1;
+        return int((((pawns * 3 + rooks) * 3 + bishops) * 3 + knights) * 2 + queens);
+    }
+
+    const std::vector<material_entry_t> &precomputed()
+    {
+        static const std::vector<material_entry_t> entries = []
+        {
+            uint64_t sides[side_materials];
+            for (unsigned pawns = 0; pawns <= 8; pawns++)
+                for (unsigned rooks = 0; rooks <= 2; rooks++)
+                    for (unsigned bishops = 0; bishops <= 2; bishops++)
+                        for (unsigned knights = 0; knights <= 2; knights++)
+                            for (unsigned queens = 0; queens <= 1; queens++)
+                            {
+                                uint64_t side = material_unit(false, piece_type::king) +
+                                                pawns * material_unit(false, piece_type::pawn) +
+                                                rooks * material_unit(false, piece_type::rook) +
+                                                bishops * material_unit(false, piece_type::bishop) +
+                                                knights * material_unit(false, piece_type::knight) +
+                                                queens * material_unit(false, piece_type::queen);
+                                sides[side_index(side)] = side;
+                            }
+            std::vector<material_entry_t> table(side_materials * side_materials);
+            for (int white = 0; white < side_materials; white++)
+                for (int black = 0; black < side_materials; black++)
+                    evaluate_material(sides[white] << 28 | sides[black], table[white * side_materials + black]);
+            return table;
+        }();
+        return entries;
+    }
+}
+
+material_table::material_table() : entries(precomputed().data())
+{
+}
+
+const material_entry_t &material_table::probe(uint64_t key)
+{
+    probes++;
+    int white = side_index(key >> 28), black = side_index(key & 0xfffffff);
+    if (white < 0 || black < 0)
+    {
+        evaluate_material(key, scratch);
+        return scratch;
+    }
+    hits++;
+    return entries[white * side_materials + black];
+}
+
+void evaluate_material(uint64_t key, material_entry_t &entry)
+{
+    entry = material_entry_t();
+    entry.key = key;
+
+    int phase = 0;
+    for (bool white : {false, true})
+        phase += material_count(key, white, piece_type::knight) + material_count(key, white, piece_type::bishop) +
+                 2 * material_count(key, white, piece_type::rook) + 4 * material_count(key, white, piece_type::queen);
+    entry.phase = uint8_t(std::min(phase, 24));
+    entry.imbalance = int16_t(imbalance(key, true) - imbalance(key, false));
+
+    for (const endgame_t &e : endgames)
+        if (e.key == key)
+        {
+            entry.evaluate = e.evaluate;
+            entry.strong_white = e.strong_white;
+            return;
+        }
+
+    int material[2] = {non_pawn_material(key, false), non_pawn_material(key, true)};
+    for (bool white : {false, true})
+    {
+        // the other side has its king alone and this side enough to mate
+        uint64_t other = white ? key & 0xfffffff : key >> 28;
+        bool bare_king = other == material_unit(false, piece_type::king);
+        bool can_mate = material_count(key, white, piece_type::queen) || material_count(key, white, piece_type::rook) ||
+                        material_count(key, white, piece_type::bishop) >= 2 ||
+                        (material_count(key, white, piece_type::bishop) && material_count(key, white, piece_type::knight));
+        if (bare_king && can_mate)
+        {
+            entry.evaluate = evaluate_kxk;
+            entry.strong_white = white;
+            return;
+        }
+
+        // without pawns a minor piece up is rarely enough
+        if (!material_count(key, white, piece_type::pawn) && material[white] - material[!white] <= piece_values[int(piece_type::bishop)])
+            entry.scale[white] = material[white] < piece_values[int(piece_type::rook)] ? 0 : 16;
+    }
+
+    bool only_bishops = material[0] == piece_values[int(piece_type::bishop)] && material[1] == material[0] &&
+                        material_count(key, false, piece_type::bishop) == 1 && material_count(key, true, piece_type::bishop) == 1;
+    if (only_bishops)
+        entry.scale_function = scale_opposite_bishops;
+}
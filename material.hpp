@@ -0,0 +1,91 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "chess.hpp"
+
+// indexed by piece_type
+constexpr std::array<int, 7> piece_values = {0, 100, 500, 0, 330, 900, 320};
+
+// below any mate, above anything the material could add up to
+constexpr int known_win = 10000;
+
+// key of a material like "KBNvK", white first, 0 if it does not parse
+constexpr uint64_t material_key(std::string_view name)
+{
+    uint64_t key = 0;
+    bool white = true;
+    for (char c : name)
+    {
+        piece_type type = piece_type::invalid;
+        switch (c)
+        {
+        case 'v':
+            if (!white)
+                return 0;
+            white = false;
+            continue;
+        case 'K':
+            type = piece_type::king;
+            break;
+        case 'Q':
+            type = piece_type::queen;
+            break;
+        case 'R':
+            type = piece_type::rook;
+            break;
+        case 'B':
+            type = piece_type::bishop;
+            break;
+        case 'N':
+            type = piece_type::knight;
+            break;
+        case 'P':
+            type = piece_type::pawn;
+            break;
+        default:
+            return 0;
+        }
+        key += material_unit(white, type);
+    }
+    return white ? 0 : key;
+}
+
+// Everything the evaluation takes from the material alone
+struct material_entry_t
+{
+    uint64_t key = 0;
+    // from white's point of view
+    int16_t imbalance = 0;
+    // 24 with all pieces on, 0 with none but kings and pawns
+    uint8_t phase = 0;
+    // part of the score kept, out of 64, when that side is ahead; 0 black, 1 white
+    uint8_t scale[2] = {64, 64};
+    // replaces the general evaluation, from white's point of view
+    int (*evaluate)(const game_t &game, bool strong_white) = nullptr;
+    // replaces scale for both sides when it depends on more than the material
+    int (*scale_function)(const game_t &game) = nullptr;
+    bool strong_white = true;
+};
+
+// Material entries for one thread. Those of every material with up to eight
+// pawns, two knights, bishops and rooks and a queen a side are worked out once
+// for all threads, about 236000. Any other, after an extra promotion, is
+// evaluated again on every probe; hits counts the probes that were not.
+class material_table
+{
+public:
+    material_table();
+    const material_entry_t &probe(uint64_t key);
+
+    uint64_t probes = 0;
+    uint64_t hits = 0;
+
+private:
+    const material_entry_t *entries;
+    material_entry_t scratch;
+};
+
+void evaluate_material(uint64_t key, material_entry_t &entry);
@@ -0,0 +1,230 @@
+#include <algorithm>
+#include <cstring>
+#include <queue>
+#include "opening_tree.hpp"
+
+namespace
+{
+    constexpr char magic[8] = {'C', 'H', 'T', 'R', 'E', 'E', '0', '1'};
+    // magic and entry count
+    constexpr size_t header_size = 16;
+
+    bool entry_less(const tree_entry_t &a, const tree_entry_t &b)
+    {
+        return a.key != b.key ? a.key < b.key : a.move < b.move;
+    }
+
+    bool same_move(const tree_entry_t &a, const tree_entry_t &b)
+    {
+        return a.key == b.key && a.move == b.move;
+    }
+
+    void add_counts(tree_entry_t &into, const tree_entry_t &from)
+    {
+        into.white_wins += from.white_wins;
+        into.draws += from.draws;
+        into.black_wins += from.black_wins;
+    }
+
+    // buffered reader over one sorted run
+    struct run_reader_t
+    {
+        FILE *file = nullptr;
+        std::vector<tree_entry_t> buffer;
+        size_t next = 0;
+
+        bool read(tree_entry_t &entry)
+        {
+            if (next == buffer.size())
+            {
+                buffer.resize(buffer.capacity());
+                buffer.resize(fread(buffer.data(), sizeof(tree_entry_t), buffer.size(), file));
+                next = 0;
+                if (buffer.empty())
+                    return false;
+            }
+            entry = buffer[next++];
+            return true;
+        }
+    };
+
+    // writes entries, merging consecutive equal ones
+    struct tree_writer_t
+    {
+        FILE *file = nullptr;
+        tree_entry_t pending{};
+        bool has_pending = false;
+        uint64_t count = 0;
+
+        bool put(const tree_entry_t &entry)
+        {
+            if (has_pending && same_move(pending, entry))
+            {
+                add_counts(pending, entry);
+                return true;
+            }
+            bool ok = flush();
+            pending = entry;
+            has_pending = true;
+            return ok;
+        }
+
+        bool flush()
+        {
+            if (!has_pending)
+                return true;
+            has_pending = false;
+            count++;
+            return fwrite(&pending, sizeof(pending), 1, file) == 1;
+        }
+    };
+
+    std::string run_path(const std::string &path, size_t run)
+    {
+        return path + ".run" + std::to_string(run);
+    }
+}
+
+opening_tree_builder::opening_tree_builder(std::string path, size_t memory_bytes)
+    : path(std::move(path)), capacity(std::max<size_t>(memory_bytes / sizeof(tree_entry_t), 1024))
+{
+    buffer.reserve(capacity);
+}
+
+opening_tree_builder::~opening_tree_builder()
+{
+    for (size_t run = 0; run < run_count; run++)
+        remove(run_path(path, run).c_str());
+}
+
+bool opening_tree_builder::add(uint64_t key, uint16_t move, bool white_turn, int result)
+{
+    tree_entry_t entry{key, move, white_turn, 0, result > 0, result == 0, result < 0};
+    buffer.push_back(entry);
+    if (buffer.size() < capacity)
+        return !failed;
+    compact();
+    // openings repeat a lot, merging alone usually makes room
+    if (buffer.size() > capacity / 2)
+        spill();
+    return !failed;
+}
+
+void opening_tree_builder::compact()
+{
+    std::sort(buffer.begin(), buffer.end(), entry_less);
+    size_t out = 0;
+    for (size_t i = 0; i < buffer.size(); i++)
+    {
+        if (out && same_move(buffer[out - 1], buffer[i]))
+            add_counts(buffer[out - 1], buffer[i]);
+        else
+            buffer[out++] = buffer[i];
+    }
+    buffer.resize(out);
+}
+
+bool opening_tree_builder::spill()
+{
+    FILE *file = fopen(run_path(path, run_count).c_str(), "wb");
+    if (!file)
+        return !(failed = true);
+    run_count++;
+    if (fwrite(buffer.data(), sizeof(tree_entry_t), buffer.size(), file) != buffer.size())
+        failed = true;
+    if (fclose(file))
+        failed = true;
+    buffer.clear();
+    return !failed;
+}
+
+bool opening_tree_builder::finish()
+{
+    compact();
+    if (run_count && !buffer.empty())
+        spill();
+    if (failed)
+        return false;
+
+    FILE *out = fopen(path.c_str(), "wb");
+    if (!out)
+        return false;
+    uint64_t count = 0;
+    fwrite(magic, 1, sizeof(magic), out);
+    fwrite(&count, sizeof(count), 1, out);
+
+    tree_writer_t writer;
+    writer.file = out;
+    bool ok = true;
+    if (!run_count)
+    {
+        for (const tree_entry_t &entry : buffer)
+            ok = writer.put(entry) && ok;
+    }
+    else
+    {
+        // k-way merge, each run gets an equal share of the memory budget
+        std::vector<run_reader_t> readers(run_count);
+        size_t share = std::max<size_t>(capacity / run_count, 256);
+        using head_t = std::pair<tree_entry_t, size_t>;
+        auto greater = [](const head_t &a, const head_t &b)
+        { return entry_less(b.first, a.first); };
+        std::priority_queue<head_t, std::vector<head_t>, decltype(greater)> heads(greater);
+        buffer = {};
+        for (size_t run = 0; run < run_count; run++)
+        {
+            readers[run].file = fopen(run_path(path, run).c_str(), "rb");
+            readers[run].buffer.reserve(share);
+            tree_entry_t entry;
+            if (!readers[run].file)
+                ok = false;
+            else if (readers[run].read(entry))
+                heads.push({entry, run});
+        }
+        while (ok && !heads.empty())
+        {
+            head_t head = heads.top();
+            heads.pop();
+            ok = writer.put(head.first);
+            if (readers[head.second].read(head.first))
+                heads.push(head);
+        }
+        for (run_reader_t &reader : readers)
+            if (reader.file)
+                fclose(reader.file);
+    }
+    ok = writer.flush() && ok;
+
+    written = writer.count;
+    fseek(out, sizeof(magic), SEEK_SET);
+    ok = fwrite(&written, sizeof(written), 1, out) == 1 && ok;
+    ok = fclose(out) == 0 && ok;
+    return ok;
+}
+
+opening_tree::opening_tree(const char *path) : file(path)
+{
+    if (!file.is_open() || file.length() < header_size || memcmp(file.bytes(), magic, sizeof(magic)))
+        return;
+    uint64_t entries;
+    memcpy(&entries, file.bytes() + sizeof(magic), sizeof(entries));
+    valid = file.length() == header_size + entries * sizeof(tree_entry_t);
+    count = valid ? size_t(entries) : 0;
+}
+
+const tree_entry_t *opening_tree::begin() const
+{
+    // the mapping is page aligned and the header keeps entries 8 byte aligned
+    return reinterpret_cast<const tree_entry_t *>(file.bytes() + header_size);
+}
+
+size_t opening_tree::find(uint64_t key, tree_entry_t *out, size_t max) const
+{
+    const tree_entry_t *first = std::lower_bound(begin(), end(), key, [](const tree_entry_t &e, uint64_t k)
+                                                 { return e.key < k; });
+    size_t count = 0;
+    for (; first != end() && first->key == key; first++, count++)
+        if (count < max)
+            out[count] = *first;
+    return count;
+}
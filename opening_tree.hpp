@@ -0,0 +1,78 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "mapped_file.hpp"
+
+// (position, move) with the results of the games that played it. Stored as
+// is in the tree file, sorted by key then move.
+struct tree_entry_t
+{
+    // polyglot_key of the position
+    uint64_t key;
+    // Polyglot move encoding, see encode_book_move
+    uint16_t move;
+    uint8_t white_turn;
+    uint8_t reserved;
+    uint32_t white_wins;
+    uint32_t draws;
+    uint32_t black_wins;
+
+    uint64_t games() const { return uint64_t(white_wins) + draws + black_wins; }
+};
+static_assert(sizeof(tree_entry_t) == 24, "the file layout depends on it");
+
+// Collects entries and writes them as a tree file. Entries are kept in a
+// buffer of bounded size; when it fills, equal entries are merged, and if
+// that frees too little the sorted buffer is spilled to a run file next to
+// the output. finish() merges the runs into the output.
+class opening_tree_builder
+{
+public:
+    opening_tree_builder(std::string path, size_t memory_bytes);
+    ~opening_tree_builder();
+    opening_tree_builder(const opening_tree_builder &) = delete;
+    opening_tree_builder &operator=(const opening_tree_builder &) = delete;
+
+    // result is 1 for a white win, 0 for a draw and -1 for a black win
+    bool add(uint64_t key, uint16_t move, bool white_turn, int result);
+    // false if a file could not be written
+    bool finish();
+
+    size_t runs() const { return run_count; }
+    uint64_t entries_written() const { return written; }
+
+private:
+    // sorts the buffer and merges equal entries
+    void compact();
+    bool spill();
+
+    std::string path;
+    std::vector<tree_entry_t> buffer;
+    size_t capacity;
+    size_t run_count = 0;
+    uint64_t written = 0;
+    bool failed = false;
+};
+
+// Read only view of a tree file
+class opening_tree
+{
+public:
+    opening_tree() = default;
+    explicit opening_tree(const char *path);
+
+    // false if the file is missing or is not a whole tree
+    bool is_open() const { return valid; }
+    size_t size() const { return count; }
+    // copies up to `max` entries for the key into out, returns how many there are
+    size_t find(uint64_t key, tree_entry_t *out, size_t max) const;
+    const tree_entry_t *begin() const;
+    const tree_entry_t *end() const { return begin() + size(); }
+
+private:
+    mapped_file file;
+    size_t count = 0;
+    bool valid = false;
+};
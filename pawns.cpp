@@ -0,0 +1,142 @@
+#include <algorithm>
+#include "pawns.hpp"
+
+namespace
+{
+    constexpr uint64_t file_a = 0x0101010101010101ull;
+    constexpr uint64_t file_h = file_a << 7;
+
+    // indexed by the rank counted from the pawn's own side, 1 being its start
+    constexpr int passed_middlegame[8] = {0, 0, 5, 10, 20, 35, 60, 0};
+    constexpr int passed_endgame[8] = {0, 0, 10, 20, 40, 70, 120, 0};
+    constexpr int doubled[2] = {12, 20};
+    constexpr int isolated[2] = {10, 15};
+    constexpr int backward[2] = {8, 10};
+
+    uint64_t north_fill(uint64_t b)
+    {
+        b |= b << 8;
+        b |= b << 16;
+        b |= b << 32;
+        return b;
+    }
+
+    uint64_t south_fill(uint64_t b)
+    {
+        b |= b >> 8;
+        b |= b >> 16;
+        b |= b >> 32;
+        return b;
+    }
+
+    uint64_t forward(uint64_t b, bool white) { return white ? b << 8 : b >> 8; }
+    // every square in front of the pawns on their files
+    uint64_t front_span(uint64_t b, bool white) { return white ? north_fill(b << 8) : south_fill(b >> 8); }
+    // the squares beside each one on the neighbouring files
+    uint64_t sideways(uint64_t b) { return ((b & ~file_a) >> 1) | ((b & ~file_h) << 1); }
+    uint64_t pawn_attacks(uint64_t b, bool white) { return forward(sideways(b), white); }
+    uint64_t adjacent_files(int x)
+    {
+        return (x > 0 ? file_a << (x - 1) : 0) | (x < 7 ? file_a << (x + 1) : 0);
+    }
+}
+
+pawn_table::pawn_table(size_t count)
+{
+    size_t size = 1;
+    while (size * 2 <= count)
+        size *= 2;
+    if (count)
+        entries.resize(size);
+}
+
+const pawn_entry_t &pawn_table::probe(uint64_t key, uint64_t white_pawns, uint64_t black_pawns)
+{
+    probes++;
+    pawn_entry_t &entry = entries.empty() ? scratch : entries[key & (entries.size() - 1)];
+    if (!entries.empty() && entry.valid && entry.key == key)
+    {
+        hits++;
+        return entry;
+    }
+    evaluate_pawns(white_pawns, black_pawns, entry);
+    entry.key = key;
+    entry.valid = true;
+    return entry;
+}
+
+void pawn_table::clear()
+{
+    std::fill(entries.begin(), entries.end(), pawn_entry_t());
+    probes = hits = 0;
+}
+
+void evaluate_pawns(uint64_t white_pawns, uint64_t black_pawns, pawn_entry_t &entry)
+{
+    int middlegame = 0, endgame = 0;
+    for (bool white : {false, true})
+    {
+        uint64_t own = white ? white_pawns : black_pawns, enemy = white ? black_pawns : white_pawns;
+        entry.attacks[white] = pawn_attacks(own, white);
+        entry.attack_span[white] = white ? north_fill(entry.attacks[white]) : south_fill(entry.attacks[white]);
+        uint64_t enemy_attacks = pawn_attacks(enemy, !white);
+        int sign = white ? 1 : -1;
+
+        for (uint64_t pawns = own; pawns; pawns &= pawns - 1)
+        {
+            int square = __builtin_ctzll(pawns);
+            uint64_t pawn = uint64_t(1) << square;
+            int x = square % 8, rank = white ? square / 8 + 1 : 8 - square / 8;
+            uint64_t neighbours = own & adjacent_files(x);
+            int mg = (rank - 2) * 8, eg = (rank - 2) * 20;
+            if (x >= 2 && x <= 5)
+            {
+                mg += 5;
+                eg += 5;
+            }
+            if (own & front_span(pawn, white))
+            {
+                mg -= doubled[0];
+                eg -= doubled[1];
+            }
+            if (!neighbours)
+            {
+                mg -= isolated[0];
+                eg -= isolated[1];
+            }
+            // no neighbour level with or behind it to support the advance, and
+            // an enemy pawn holds the square in front
+            else if (!(neighbours & sideways(white ? south_fill(pawn) : north_fill(pawn))) &&
+                     (forward(pawn, white) & enemy_attacks))
+            {
+                mg -= backward[0];
+                eg -= backward[1];
+            }
+            uint64_t blockers = enemy & front_span(pawn | sideways(pawn), white);
+            if (!blockers && !(own & front_span(pawn, white)))
+            {
+                mg += passed_middlegame[rank - 1];
+                eg += passed_endgame[rank - 1];
+            }
+            middlegame += sign * mg;
+            endgame += sign * eg;
+        }
+
+        // for each king file the three files around it: a pawn still on its
+        // start rank shelters best, one step up a little, none at all costs
+        for (int king_x = 0; king_x < 8; king_x++)
+        {
+            int shelter = 0;
+            for (int x = std::max(king_x - 1, 0); x <= std::min(king_x + 1, 7); x++)
+            {
+                uint64_t file = own & (file_a << x);
+                uint64_t second = file_a << x & (white ? 0xff00ull : 0xff000000000000ull);
+                uint64_t third = file_a << x & (white ? 0xff0000ull : 0xff0000000000ull);
+                shelter += (file & second) ? 12 : (file & third) ? 6 : -10;
+            }
+            entry.shelter[white][king_x] = int8_t(shelter);
+        }
+    }
+    entry.middlegame = int16_t(middlegame);
+    entry.endgame = int16_t(endgame);
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Pawn bitboards use bit (y - 1) * 8 + (x - 1), a1 = bit 0. Colour indices
+// are 0 for black and 1 for white, as piece_t::iswhite() converts.
+
+// Everything the evaluation wants from the pawns alone
+struct pawn_entry_t
+{
+    uint64_t key = 0;
+    bool valid = false;
+    // structure terms from white's point of view
+    int16_t middlegame = 0;
+    int16_t endgame = 0;
+    // squares the pawns attack now, and every square they could attack
+    // after advancing
+    uint64_t attacks[2] = {};
+    uint64_t attack_span[2] = {};
+    // shelter from the own pawns for a king on each file
+    int8_t shelter[2][8] = {};
+};
+
+// Cache of pawn evaluations for one thread, indexed by a key built from
+// zobrist_key of the pawns alone. Pawn structure changes on few moves, so
+// most nodes find theirs here.
+class pawn_table
+{
+public:
+    // 0 entries evaluates every time
+    explicit pawn_table(size_t count = 1 << 14);
+    const pawn_entry_t &probe(uint64_t key, uint64_t white_pawns, uint64_t black_pawns);
+    void clear();
+
+    uint64_t probes = 0;
+    uint64_t hits = 0;
+
+private:
+    std::vector<pawn_entry_t> entries;
+    pawn_entry_t scratch;
+};
+
+void evaluate_pawns(uint64_t white_pawns, uint64_t black_pawns, pawn_entry_t &entry);
@@ -0,0 +1,88 @@
+#include <imgui/imgui.h>
+#include "perf_overlay.hpp"
+
+void perf_overlay::begin_frame()
+{
+    frame_start = visible ? steady_ns() : 0;
+}
+
+void perf_overlay::end_frame(unsigned calls)
+{
+    // F3 shows the overlay between begin_frame() and end_frame(), and that
+    // frame has no start to measure from
+    if (!visible || !frame_start)
+        return;
+    frame_ms.push((steady_ns() - frame_start) / 1e6f);
+    draw_calls.push(float(calls));
+}
+
+void perf_overlay::analysed(const analysis_t &analysis)
+{
+    if (!visible || !analysis.generation || analysis.generation == analysis_generation)
+        return;
+    analysis_generation = analysis.generation;
+    rules_us.push(float(analysis.elapsed.count()));
+}
+
+void perf_overlay::searched(const search_info_t &info)
+{
+    if (!visible || !info.nodes || (info.nodes == engine_nodes && info.depth == engine_depth))
+        return;
+    engine_nodes = info.nodes;
+    engine_depth = info.depth;
+    engine = info;
+    nps.push(float(info.nps()));
+}
+
+void perf_overlay::rendered(int64_t cpu_ns, float gpu_us, bool redrawn)
+{
+    if (!visible)
+        return;
+    render_cpu_us = cpu_ns / 1e3f;
+    render_us.push(gpu_us);
+    redraws.push(redrawn);
+}
+
+void perf_overlay::started(int64_t first_frame_ns, int64_t sprites_wait_ns)
+{
+    first_frame_ms = first_frame_ns / 1e6f;
+    sprites_wait_ms = sprites_wait_ns / 1e6f;
+}
+
+void perf_overlay::draw()
+{
+    if (!visible)
+        return;
+    ImGui::SetNextWindowPos({10, 10}, ImGuiCond_FirstUseEver);
+    ImGui::SetNextWindowBgAlpha(0.8f);
+    if (!ImGui::Begin("Performance (F3)", &visible, ImGuiWindowFlags_AlwaysAutoResize))
+    {
+        ImGui::End();
+        return;
+    }
+    ImGui::Text("first frame after %.1f ms, %.2f ms waiting for sprites", first_frame_ms, sprites_wait_ms);
+    char label[64];
+    snprintf(label, sizeof(label), "%.2f ms", frame_ms.last());
+    ImGui::PlotLines("frame", frame_ms.values.data(), history, frame_ms.next, label, 0, FLT_MAX, {240, 40});
+    snprintf(label, sizeof(label), "%.0f", draw_calls.last());
+    ImGui::PlotLines("draw calls", draw_calls.values.data(), history, draw_calls.next, label, 0, FLT_MAX, {240, 40});
+    snprintf(label, sizeof(label), "%.0f us gpu  %.0f us cpu", render_us.last(), render_cpu_us);
+    ImGui::PlotLines("board", render_us.values.data(), history, render_us.next, label, 0, FLT_MAX, {240, 40});
+    int redrawn = 0;
+    for (float r : redraws.values)
+        redrawn += r > 0;
+    ImGui::Text("board redrawn in %d of the last %d frames", redrawn, history);
+    snprintf(label, sizeof(label), "%.0f us", rules_us.last());
+    ImGui::PlotLines("rules", rules_us.values.data(), history, rules_us.next, label, 0, FLT_MAX, {240, 40});
+    if (engine_nodes)
+    {
+        snprintf(label, sizeof(label), "%.0f nps", nps.last());
+        ImGui::PlotLines("engine", nps.values.data(), history, nps.next, label, 0, FLT_MAX, {240, 40});
+        ImGui::Text("depth %d  nodes %llu  tt hits %.1f%%  hashfull %d%%", engine.depth,
+                    (unsigned long long)engine.nodes,
+                    engine.tt_probes ? 100.0 * engine.tt_hits / engine.tt_probes : 0.0, engine.hashfull / 10);
+    }
+    else
+        ImGui::TextDisabled("engine idle");
+    ImGui::End();
+}
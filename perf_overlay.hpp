@@ -0,0 +1,58 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include "analysis.hpp"
+#include "search.hpp"
+
+// Rolling frame, rules and engine metrics drawn as an ImGui window. While it
+// is hidden nothing is timed or recorded and the engine is not asked for
+// progress.
+class perf_overlay
+{
+public:
+    bool visible = false;
+
+    // brackets the work of one frame, up to but not including the swap
+    void begin_frame();
+    void end_frame(unsigned draw_calls);
+    // each new analysis and each engine iteration, only recorded once
+    void analysed(const analysis_t &analysis);
+    void searched(const search_info_t &info);
+    // the board's share of the frame, and whether its cached layer was redrawn
+    void rendered(int64_t cpu_ns, float gpu_us, bool redrawn);
+    // time from launch to the first frame on screen, and how much of it was
+    // spent waiting for the sprites; recorded even while hidden
+    void started(int64_t first_frame_ns, int64_t sprites_wait_ns);
+    void draw();
+
+private:
+    static constexpr int history = 120;
+    // ring of the last `history` samples, oldest at `next`
+    struct series_t
+    {
+        std::array<float, history> values{};
+        int next = 0;
+        float last() const { return values[(next + history - 1) % history]; }
+        void push(float value)
+        {
+            values[next] = value;
+            next = (next + 1) % history;
+        }
+    };
+
+    // 0 when the frame began with the overlay hidden
+    int64_t frame_start = 0;
+    series_t frame_ms;
+    series_t draw_calls;
+    series_t rules_us;
+    series_t render_us;
+    series_t redraws;
+    float render_cpu_us = 0;
+    float first_frame_ms = 0, sprites_wait_ms = 0;
+    series_t nps;
+    uint64_t analysis_generation = 0;
+    search_info_t engine;
+    // identifies the iteration last recorded
+    uint64_t engine_nodes = 0;
+    int engine_depth = 0;
+};
@@ -0,0 +1,379 @@
+#include <cstring>
+#include "pgn.hpp"
+
+namespace
+{
+    // memchr is vectorised by the C library, everything that skips over long
+    // runs of text goes through it
+    const char *find(const char *p, const char *end, char c)
+    {
+        const void *found = memchr(p, c, end - p);
+        return found ? static_cast<const char *>(found) : end;
+    }
+
+    bool is_space(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+    const char *skip_space(const char *p, const char *end)
+    {
+        while (p < end && is_space(*p))
+            p++;
+        return p;
+    }
+
+    std::string_view trimmed(const char *begin, const char *end)
+    {
+        while (begin < end && is_space(*begin))
+            begin++;
+        while (end > begin && is_space(end[-1]))
+            end--;
+        return {begin, size_t(end - begin)};
+    }
+
+    // [Name "Value"] on one line, anything else is ignored
+    void parse_tag(const char *p, const char *end, std::vector<pgn_tag_t> &tags)
+    {
+        const char *name = ++p;
+        while (p < end && !is_space(*p) && *p != '"' && *p != ']')
+            p++;
+        std::string_view tag_name(name, p - name);
+        p = find(p, end, '"');
+        if (p == end || tag_name.empty())
+            return;
+        const char *value = ++p;
+        // an escaped quote does not end the value
+        while ((p = find(p, end, '"')) < end && p[-1] == '\\')
+            p++;
+        if (p == end)
+            return;
+        tags.push_back({tag_name, {value, size_t(p - value)}});
+    }
+
+    piece_type type_from_letter(char c)
+    {
+        switch (c)
+        {
+        case 'R':
+            return piece_type::rook;
+        case 'K':
+            return piece_type::king;
+        case 'B':
+            return piece_type::bishop;
+        case 'Q':
+            return piece_type::queen;
+        case 'N':
+            return piece_type::knight;
+        default:
+            return piece_type::invalid;
+        }
+    }
+
+    // indexed by piece_type
+    constexpr char letters[] = "?PRKBQN";
+
+    bool is_result(std::string_view token)
+    {
+        return token == "1-0" || token == "0-1" || token == "1/2-1/2" || token == "*";
+    }
+
+    // legal without leaving the own king in check
+    bool legal(const game_t &game, piece_t piece, coordinate_t to)
+    {
+        game_t g = game;
+        g.set_current_piece(piece);
+        g.move(to.x, to.y);
+        return !g.in_check(game.white_turn);
+    }
+}
+
+std::string_view pgn_game_t::tag(std::string_view name) const
+{
+    for (const pgn_tag_t &t : tags)
+        if (t.name == name)
+            return t.value;
+    return {};
+}
+
+size_t read_pgn(std::string_view text, const std::function<bool(const pgn_game_t &)> &on_game)
+{
+    pgn_game_t game;
+    size_t count = 0;
+    const char *p = text.data(), *end = p + text.size();
+    // byte order mark
+    if (text.size() >= 3 && memcmp(p, "\xef\xbb\xbf", 3) == 0)
+        p += 3;
+
+    while ((p = skip_space(p, end)) < end)
+    {
+        const char *start = p;
+        game.tags.clear();
+        while (p < end && *p == '[')
+        {
+            const char *line_end = find(p, end, '\n');
+            parse_tag(p, line_end, game.tags);
+            p = skip_space(line_end, end);
+        }
+
+        // the movetext runs to the next line starting a tag, comments may
+        // span lines and are skipped whole
+        const char *moves = p;
+        while (p < end && *p != '[')
+        {
+            const char *line_end = find(p, end, '\n');
+            const char *brace = find(p, line_end, '{');
+            while (brace < line_end)
+            {
+                const char *close = find(brace, end, '}');
+                line_end = find(close, end, '\n');
+                brace = close < end ? find(close, line_end, '{') : end;
+            }
+            p = line_end < end ? line_end + 1 : end;
+        }
+
+        game.movetext = trimmed(moves, p);
+        game.text = trimmed(start, p);
+        count++;
+        if (!on_game(game))
+            break;
+    }
+    return count;
+}
+
+std::string_view for_each_san(std::string_view movetext, const std::function<bool(std::string_view)> &on_token)
+{
+    const char *p = movetext.data(), *end = p + movetext.size();
+    while ((p = skip_space(p, end)) < end)
+    {
+        switch (*p)
+        {
+        case '{':
+            p = find(p, end, '}');
+            p += p < end;
+            continue;
+        case ';':
+            p = find(p, end, '\n');
+            continue;
+        case '(':
+        {
+            // variations nest and may contain comments with parentheses
+            int depth = 0;
+            while (p < end)
+            {
+                if (*p == '{')
+                    p = find(p, end, '}');
+                else if (*p == ';')
+                    p = find(p, end, '\n');
+                else if (*p == '(')
+                    depth++;
+                else if (*p == ')' && --depth == 0)
+                {
+                    p++;
+                    break;
+                }
+                p += p < end;
+            }
+            continue;
+        }
+        case '$':
+            p++;
+            while (p < end && *p >= '0' && *p <= '9')
+                p++;
+            continue;
+        case ')':
+            // closes no variation, seen in broken exports
+            p++;
+            continue;
+        default:
+            break;
+        }
+
+        const char *token = p;
+        while (p < end && !is_space(*p) && *p != '{' && *p != '(' && *p != ';' && *p != ')')
+            p++;
+        std::string_view word(token, p - token);
+        if (is_result(word))
+            return word;
+
+        // move numbers, "12." or "12..." possibly glued to the move
+        size_t i = 0;
+        while (i < word.size() && word[i] >= '0' && word[i] <= '9')
+            i++;
+        if (i && i < word.size() && word[i] == '.')
+        {
+            while (i < word.size() && word[i] == '.')
+                i++;
+            word.remove_prefix(i);
+        }
+        else if (i == word.size())
+            continue;
+        if (word.empty())
+            continue;
+        if (!on_token(word))
+            return {};
+    }
+    return {};
+}
+
+bool parse_san(const game_t &game, std::string_view san, move_t &move)
+{
+    // check, mate and annotation suffixes, and the old "e.p." marker
+    while (!san.empty() && (san.back() == '+' || san.back() == '#' || san.back() == '!' || san.back() == '?'))
+        san.remove_suffix(1);
+    if (san.size() > 4 && san.substr(san.size() - 4) == "e.p.")
+        san.remove_suffix(4);
+    if (san.size() < 2)
+        return false;
+
+    uint8_t home = game.white_turn ? 1 : 8;
+    if (san == "O-O" || san == "0-0" || san == "O-O-O" || san == "0-0-0")
+    {
+        piece_t king = game.get(5, home);
+        coordinate_t to(san.size() == 3 ? 7 : 3, home);
+        if (!king.isking() || king.iswhite() != game.white_turn)
+            return false;
+        game_t g = game;
+        g.set_current_piece(king);
+        auto moves = king.available_moves(g, game.white_turn, game.enpassant);
+        if (std::find(moves.begin(), moves.end(), to) == moves.end())
+            return false;
+        move = {king.get_position(), to};
+        return true;
+    }
+
+    move.promotion = piece_type::invalid;
+    char last = san.back();
+    if (last == 'Q' || last == 'R' || last == 'B' || last == 'N')
+    {
+        move.promotion = type_from_letter(last);
+        san.remove_suffix(1);
+        if (!san.empty() && san.back() == '=')
+            san.remove_suffix(1);
+    }
+    if (san.size() < 2)
+        return false;
+    char file = san[san.size() - 2], rank = san.back();
+    if (file < 'a' || file > 'h' || rank < '1' || rank > '8')
+        return false;
+    coordinate_t to(file - 'a' + 1, rank - '0');
+    san.remove_suffix(2);
+
+    piece_type type = piece_type::pawn;
+    if (!san.empty() && san.front() >= 'A' && san.front() <= 'Z')
+    {
+        type = type_from_letter(san.front());
+        if (type == piece_type::invalid)
+            return false;
+        san.remove_prefix(1);
+    }
+    if (!san.empty() && (san.back() == 'x' || san.back() == ':'))
+        san.remove_suffix(1);
+    // what is left disambiguates by file, rank or both
+    int from_x = 0, from_y = 0;
+    for (char c : san)
+    {
+        if (c >= 'a' && c <= 'h')
+            from_x = c - 'a' + 1;
+        else if (c >= '1' && c <= '8')
+            from_y = c - '0';
+        else
+            return false;
+    }
+    uint8_t last_rank = game.white_turn ? 8 : 1;
+    if ((type == piece_type::pawn && to.y == last_rank) != (move.promotion != piece_type::invalid))
+        return false;
+
+    bool found = false;
+    for (const auto &row : game.board)
+        for (const auto &piece : row)
+        {
+            if (piece.get_type() != type || piece.iswhite() != game.white_turn)
+                continue;
+            coordinate_t from = piece.get_position();
+            if ((from_x && from.x != from_x) || (from_y && from.y != from_y))
+                continue;
+            // a pawn without a file given pushes straight up
+            if (type == piece_type::pawn && !from_x && from.x != to.x)
+                continue;
+            auto moves = piece.pseudo_moves(game, game.white_turn, game.enpassant);
+            if (std::find(moves.begin(), moves.end(), to) == moves.end() || !legal(game, piece, to))
+                continue;
+            if (found)
+                return false;
+            found = true;
+            move.from = from;
+            move.to = to;
+        }
+    return found;
+}
+
+std::string to_san(const game_t &game, move_t move)
+{
+    std::string san;
+    piece_t piece = game.get(move.from);
+    int distance = int(move.to.x) - int(move.from.x);
+    if (piece.isking() && (distance == 2 || distance == -2))
+        san = distance > 0 ? "O-O" : "O-O-O";
+    else
+    {
+        if (piece.ispawn())
+        {
+            if (move.from.x != move.to.x)
+                san += char('a' + move.from.x - 1);
+        }
+        else
+        {
+            san += letters[int(piece.get_type())];
+            // other pieces of the kind that could go to the same square
+            bool other = false, same_file = false, same_rank = false;
+            for (move_t m : game.legal_moves())
+            {
+                if (m.to != move.to || m.from == move.from || game.get(m.from).get_type() != piece.get_type())
+                    continue;
+                other = true;
+                same_file = same_file || m.from.x == move.from.x;
+                same_rank = same_rank || m.from.y == move.from.y;
+            }
+            if (other && (!same_file || same_rank))
+                san += char('a' + move.from.x - 1);
+            if (other && same_file)
+                san += char('0' + move.from.y);
+        }
+        if (game.is_capture(move))
+            san += 'x';
+        san += char('a' + move.to.x - 1);
+        san += char('0' + move.to.y);
+        if (move.promotion != piece_type::invalid)
+        {
+            san += '=';
+            san += letters[int(move.promotion)];
+        }
+    }
+
+    game_t after = game;
+    after.play(move);
+    if (after.in_check(after.white_turn))
+        san += after.legal_moves().empty() ? '#' : '+';
+    return san;
+}
+
+bool replay_pgn(const pgn_game_t &pgn, game_t &game,
+                const std::function<void(const game_t &, move_t)> &on_move)
+{
+    static const game_t start;
+    std::string_view fen = pgn.tag("FEN");
+    if (fen.empty())
+        game = start;
+    else if (!game_t::from_fen(fen, game))
+        return false;
+
+    bool resolved = true;
+    for_each_san(pgn.movetext, [&](std::string_view san)
+                 {
+        move_t move;
+        if (!parse_san(game, san, move))
+            return resolved = false;
+        if (on_move)
+            on_move(game, move);
+        game.play(move);
+        return true; });
+    return resolved;
+}
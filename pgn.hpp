@@ -0,0 +1,44 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "chess.hpp"
+
+struct pgn_tag_t
+{
+    std::string_view name;
+    // without the quotes, escapes are left as they are
+    std::string_view value;
+};
+
+// One game, every view points into the text given to read_pgn
+struct pgn_game_t
+{
+    std::string_view text;
+    std::vector<pgn_tag_t> tags;
+    std::string_view movetext;
+
+    std::string_view tag(std::string_view name) const;
+};
+
+// Splits text into games and calls on_game for each until it returns false.
+// The game handed over is reused for the next one. Returns the number of games.
+size_t read_pgn(std::string_view text, const std::function<bool(const pgn_game_t &)> &on_game);
+
+// Calls on_token for each move of the main line, skipping move numbers,
+// comments, variations, NAGs and the result. Returns the result token, or an
+// empty view if the game has none.
+std::string_view for_each_san(std::string_view movetext, const std::function<bool(std::string_view)> &on_token);
+
+// Finds the legal move a SAN token names, check and annotation suffixes
+// allowed. False if it names no legal move or more than one.
+bool parse_san(const game_t &game, std::string_view san, move_t &move);
+std::string to_san(const game_t &game, move_t move);
+
+// Sets up the game's start position, honouring a FEN tag, and plays its
+// main line. on_move sees each position before its move is played. Returns
+// false at the first move that does not resolve, `game` then holds the
+// position it was tried in.
+bool replay_pgn(const pgn_game_t &pgn, game_t &game,
+                const std::function<void(const game_t &, move_t)> &on_move = nullptr);
@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "book.hpp"
+#include "pgn_import.hpp"
+
+namespace
+{
+    struct chunk_t
+    {
+        std::string_view text;
+        size_t first_index = 0;
+        std::vector<pgn_record_t> records;
+        bool claimed = false;
+        bool done = false;
+    };
+
+    // shared between the calling thread and the workers, all under `mutex`
+    struct pipeline_t
+    {
+        std::mutex mutex;
+        std::condition_variable work, done;
+        // in file order, the front is the next one for the sink. A deque keeps
+        // references to the others valid while the front is popped.
+        std::deque<chunk_t> chunks;
+        bool quit = false;
+    };
+
+    void replay_chunk(chunk_t &chunk, size_t book_plies)
+    {
+        game_t game;
+        read_pgn(chunk.text, [&](const pgn_game_t &pgn)
+                 {
+            chunk.records.emplace_back();
+            pgn_record_t &record = chunk.records.back();
+            record.index = chunk.first_index + chunk.records.size() - 1;
+            record.game = pgn;
+            record.replayed = replay_pgn(pgn, game, [&](const game_t &before, move_t move)
+                                         {
+                if (record.moves.empty())
+                    record.white_starts = before.white_turn;
+                if (record.moves.size() < book_plies)
+                {
+                    record.book_keys.push_back(polyglot_key(before));
+                    record.book_moves.push_back(encode_book_move(before, move));
+                }
+                record.moves.push_back(move);
+                record.keys.push_back(before.hash()); });
+            record.keys.push_back(game.hash());
+            return true; });
+    }
+
+    void work(pipeline_t &pipeline, size_t book_plies)
+    {
+        std::unique_lock<std::mutex> lock(pipeline.mutex);
+        while (true)
+        {
+            chunk_t *chunk = nullptr;
+            pipeline.work.wait(lock, [&]
+                               {
+                for (chunk_t &c : pipeline.chunks)
+                    if (!c.claimed)
+                    {
+                        chunk = &c;
+                        break;
+                    }
+                return pipeline.quit || chunk; });
+            if (pipeline.quit)
+                return;
+            chunk->claimed = true;
+            lock.unlock();
+
+            replay_chunk(*chunk, book_plies);
+
+            lock.lock();
+            chunk->done = true;
+            pipeline.done.notify_one();
+        }
+    }
+}
+
+size_t import_pgn(std::string_view text, const std::function<bool(const pgn_record_t &)> &sink,
+                  const pgn_import_options_t &options)
+{
+    unsigned threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    size_t max_chunks = options.max_chunks ? options.max_chunks : 2 * threads;
+    size_t chunk_bytes = std::max<size_t>(options.chunk_bytes, 1);
+
+    pipeline_t pipeline;
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < threads; i++)
+        workers.emplace_back(work, std::ref(pipeline), options.book_plies);
+
+    size_t split = 0, delivered = 0;
+    bool stopped = false;
+    std::unique_lock<std::mutex> lock(pipeline.mutex);
+    while (!stopped)
+    {
+        if (!pipeline.chunks.empty() && pipeline.chunks.front().done)
+        {
+            // the sink runs without the lock so the workers carry on meanwhile
+            chunk_t chunk = std::move(pipeline.chunks.front());
+            pipeline.chunks.pop_front();
+            pipeline.work.notify_all();
+            lock.unlock();
+            for (const pgn_record_t &record : chunk.records)
+            {
+                delivered++;
+                if (!sink(record))
+                {
+                    stopped = true;
+                    break;
+                }
+            }
+            lock.lock();
+            continue;
+        }
+
+        if (text.empty() && pipeline.chunks.empty())
+            break;
+        if (text.empty() || pipeline.chunks.size() >= max_chunks)
+        {
+            pipeline.done.wait(lock, [&]
+                               { return pipeline.chunks.front().done; });
+            continue;
+        }
+
+        // the splitter uses the same reader as the workers, so a chunk always
+        // ends where a game does even when comments hold lines starting with '['
+        lock.unlock();
+        chunk_t chunk;
+        chunk.first_index = split;
+        const char *begin = nullptr, *end = nullptr;
+        read_pgn(text, [&](const pgn_game_t &game)
+                 {
+            if (!begin)
+                begin = game.text.data();
+            end = game.text.data() + game.text.size();
+            split++;
+            return size_t(end - begin) < chunk_bytes; });
+        if (!begin)
+        {
+            // nothing but white space left
+            text = {};
+            lock.lock();
+            continue;
+        }
+        chunk.text = {begin, size_t(end - begin)};
+        text.remove_prefix(end - text.data());
+        lock.lock();
+        pipeline.chunks.push_back(std::move(chunk));
+        pipeline.work.notify_one();
+    }
+
+    pipeline.quit = true;
+    lock.unlock();
+    pipeline.work.notify_all();
+    for (std::thread &worker : workers)
+        worker.join();
+    return delivered;
+}
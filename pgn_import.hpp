@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "pgn.hpp"
+
+// One game after replay. Views point into the text given to import_pgn.
+struct pgn_record_t
+{
+    // position of the game in the file, counting from 0
+    size_t index = 0;
+    pgn_game_t game;
+    // every move of the main line resolved
+    bool replayed = false;
+    // side to move before the first move, white unless a FEN tag says otherwise
+    bool white_starts = true;
+    // main line up to the first move that did not resolve
+    std::vector<move_t> moves;
+    // hash of the position before each move and after the last, so one
+    // longer than moves
+    std::vector<uint64_t> keys;
+    // polyglot_key and encode_book_move before each of the first
+    // options.book_plies moves
+    std::vector<uint64_t> book_keys;
+    std::vector<uint16_t> book_moves;
+};
+
+struct pgn_import_options_t
+{
+    // 0 uses every hardware thread
+    unsigned threads = 0;
+    // games are handed to the workers in chunks of about this much text
+    size_t chunk_bytes = 1 << 20;
+    // chunks split but not yet passed to the sink. Bounds memory together
+    // with chunk_bytes however large the input is.
+    size_t max_chunks = 0;
+    // moves of each game that also get Polyglot book keys, computed by the
+    // workers so a book builder's sink only has to store them
+    size_t book_plies = 0;
+};
+
+// Splits text into chunks at game boundaries, replays the games on a pool of
+// worker threads and calls sink with each of them in file order, from the
+// calling thread, until it returns false. Returns the number of games the
+// sink saw.
+size_t import_pgn(std::string_view text, const std::function<bool(const pgn_record_t &)> &sink,
+                  const pgn_import_options_t &options = {});
@@ -1,17 +1,21 @@
 #include <GL/glew.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
 #include "rendering.hpp"
 
-// Shader sources
+// Squares of a square_batch, moved to their board square and atlas rect per instance
 const GLchar *vertexSource = R"glsl(
     #version 330 core
     in vec2 position;
     in vec2 texcoord;
+    in vec2 square;
+    in vec4 uv;
     out vec2 Texcoord;
-    uniform vec2 offset;
     void main()
     {
-        Texcoord = texcoord;
-        gl_Position = vec4(position + offset, 0.0, 1.0);
+        Texcoord = mix(uv.xy, uv.zw, texcoord);
+        gl_Position = vec4(position + 0.25 * (square - 5.0), 0.0, 1.0);
     }
 )glsl";
 
@@ -19,10 +23,10 @@ const GLchar *fragmentSource = R"glsl(
     #version 330 core
     in vec2 Texcoord;
     out vec4 outColor;
-    uniform sampler2D board;
+    uniform sampler2D atlas;
     void main()
     {
-        outColor = texture(board, Texcoord);
+        outColor = texture(atlas, Texcoord);
     }
 )glsl";
 
@@ -129,16 +133,59 @@ void texture::bind() const
     glBindTexture(GL_TEXTURE_2D, id);
 }
 
-void drawing_params::draw(uint8_t x, uint8_t y) const
+int texture_atlas::add(const void *image, int w, int h)
 {
-    VAO.bind();
-    vbo.bind();
-    Shader.use();
-    glUniform2f(glGetUniformLocation(Shader.get_id(), "offset"), 0.25f * (x - 5), 0.25f * (y - 5));
-    tex.bind();
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    if (shelf_x + w + 2 > width)
+    {
+        shelf_y += shelf_height;
+        shelf_x = shelf_height = 0;
+    }
+    placed.push_back({shelf_x + 1, shelf_y + 1, w, h});
+    shelf_x += w + 2;
+    shelf_height = std::max(shelf_height, h + 2);
+    height = std::max(height, shelf_y + shelf_height);
+    pixels.resize(size_t(width) * height);
+
+    // the border repeats the nearest edge pixel
+    const auto *source = static_cast<const std::array<uint8_t, 4> *>(image);
+    const placed_t &p = placed.back();
+    for (int y = -1; y <= h; y++)
+        for (int x = -1; x <= w; x++)
+            pixels[size_t(p.y + y) * width + p.x + x] =
+                source[std::min(std::max(y, 0), h - 1) * w + std::min(std::max(x, 0), w - 1)];
+    return int(placed.size()) - 1;
+}
+
+void texture_atlas::pack()
+{
+    int rows = 1;
+    while (rows < height)
+        rows *= 2;
+    height = rows;
+    pixels.resize(size_t(width) * height);
+    rects.clear();
+    for (const placed_t &p : placed)
+        rects.push_back({GLfloat(p.x) / width, GLfloat(p.y) / height, GLfloat(p.x + p.w) / width, GLfloat(p.y + p.h) / height});
+}
+
+texture texture_atlas::upload(GLenum interpolation)
+{
+    pack();
+    // glTexImage2D reads from the buffer, so the driver can return once it has
+    // the copy and transfer it to the GPU in the background
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, GLsizeiptr(pixels.size() * sizeof(pixels[0])), pixels.data(), GL_STREAM_DRAW);
+    texture atlas(0, "atlas", nullptr, width, height, interpolation);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    // freed once the transfer is done
+    glDeleteBuffers(1, &buffer);
+    return atlas;
 }
 
+unsigned draw_calls = 0;
+
 void set_layout(GLuint shaderProgram)
 {
     // Specify the layout of the vertex data
@@ -151,19 +198,111 @@ void set_layout(GLuint shaderProgram)
     glVertexAttribPointer(texAttrib, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (void *)(2 * sizeof(GLfloat)));
 }
 
-drawing_params setup_square(const void *image, int width, int height, float size, GLenum interpolation)
+square_batch::square_batch(float size, texture atlas) : vbo(size), atlas(atlas)
 {
-    vao VAO;
-    square_vbo vbo(size);
-
-    static square_ebo ebo; // same for every square
+    static square_ebo ebo; // same for every batch
     ebo.bind();
 
-    static shader square_texture_shader(vertexSource, fragmentSource); // same shader for every square
+    static shader square_texture_shader(vertexSource, fragmentSource); // same shader for every batch
+    Shader = square_texture_shader;
+    set_layout(Shader.get_id());
+
+    // a square_instance_t per square, advanced once per instance
+    glGenBuffers(1, &instance_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+    GLint squareAttrib = glGetAttribLocation(Shader.get_id(), "square");
+    glEnableVertexAttribArray(squareAttrib);
+    glVertexAttribPointer(squareAttrib, 2, GL_FLOAT, GL_FALSE, sizeof(square_instance_t), 0);
+    glVertexAttribDivisor(squareAttrib, 1);
+
+    GLint uvAttrib = glGetAttribLocation(Shader.get_id(), "uv");
+    glEnableVertexAttribArray(uvAttrib);
+    glVertexAttribPointer(uvAttrib, 4, GL_FLOAT, GL_FALSE, sizeof(square_instance_t), (void *)offsetof(square_instance_t, uv));
+    glVertexAttribDivisor(uvAttrib, 1);
+}
 
-    static GLuint shaderProgram = square_texture_shader.get_id();
+void square_batch::draw() const
+{
+    if (instances.empty())
+        return;
+    draw_calls++;
+    VAO.bind();
+    Shader.use();
+    atlas.bind();
+    // orphans last frame's storage rather than waiting for it
+    glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+    glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(square_instance_t), instances.data(), GL_STREAM_DRAW);
+    glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, GLsizei(instances.size()));
+}
 
-    set_layout(shaderProgram);
-    texture tex(shaderProgram, "tex", image, width, height, interpolation);
-    return drawing_params{VAO, vbo, ebo, square_texture_shader, tex};
-};
\ No newline at end of file
+cached_batch::cached_batch(int width, int height, float size, texture atlas) : batch(size, atlas), width(width), height(height)
+{
+    GLint previous;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glGenRenderbuffers(1, &colour);
+    glBindRenderbuffer(GL_RENDERBUFFER, colour);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colour);
+    glBindFramebuffer(GL_FRAMEBUFFER, previous);
+}
+
+bool cached_batch::update()
+{
+    const std::vector<square_instance_t> &squares = batch.squares();
+    if (valid && squares.size() == drawn.size() &&
+        std::memcmp(squares.data(), drawn.data(), squares.size() * sizeof(square_instance_t)) == 0)
+        return false;
+    GLint previous;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, width, height);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    batch.draw();
+    glBindFramebuffer(GL_FRAMEBUFFER, previous);
+    drawn = squares;
+    valid = true;
+    return true;
+}
+
+void cached_batch::blit() const
+{
+    draw_calls++;
+    GLint previous;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previous);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, previous);
+}
+
+gpu_timer::gpu_timer()
+{
+    glGenQueries(2, queries);
+}
+
+void gpu_timer::begin()
+{
+    // started two frames ago, almost always done by now. If not the
+    // measurement is dropped rather than waited for.
+    if (pending[current])
+    {
+        GLint available = 0;
+        glGetQueryObjectiv(queries[current], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            GLuint64 ns;
+            glGetQueryObjectui64v(queries[current], GL_QUERY_RESULT, &ns);
+            last = ns / 1e3f;
+        }
+    }
+    glBeginQuery(GL_TIME_ELAPSED, queries[current]);
+}
+
+void gpu_timer::end()
+{
+    glEndQuery(GL_TIME_ELAPSED);
+    pending[current] = true;
+    current ^= 1;
+}
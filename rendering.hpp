@@ -1,6 +1,8 @@
 #pragma once
 #include <GL/glew.h>
 #include <array>
+#include <cstdint>
+#include <vector>
 class shader
 {
 public:
@@ -54,14 +56,112 @@ private:
     GLuint id;
 };
 
-struct drawing_params
+// where an image lies in an atlas, in texture coordinates. (u0, v0) is the
+// corner shown at the top left of a square.
+struct uv_rect_t
 {
+    GLfloat u0, v0, u1, v1;
+};
+
+// Packs RGBA images into shelves of one texture. Each image gets a one pixel
+// border copied from its edges, so linear filtering inside its rect samples
+// as GL_CLAMP_TO_EDGE would on a texture of its own.
+class texture_atlas
+{
+public:
+    explicit texture_atlas(int width = 512) : width(width) {}
+    // width * height RGBA pixels, returns the index of its rect
+    int add(const void *pixels, int w, int h);
+    // a single colour, sampled the same anywhere in its rect
+    int add(std::array<uint8_t, 4> colour) { return add(colour.data(), 1, 1); }
+    // lays the pixels out as the texture will hold them, rect() is valid
+    // after. Needs no GL context, so it can run on any thread.
+    void pack();
+    // packs, then creates the texture through a pixel buffer object
+    texture upload(GLenum interpolation = GL_LINEAR);
+    uv_rect_t rect(int index) const { return rects[index]; }
+
+private:
+    struct placed_t
+    {
+        int x, y, w, h;
+    };
+    int width, height = 0;
+    // the shelf being filled
+    int shelf_x = 0, shelf_y = 0, shelf_height = 0;
+    std::vector<placed_t> placed;
+    std::vector<uv_rect_t> rects;
+    std::vector<std::array<uint8_t, 4>> pixels;
+};
+
+// one square of a square_batch: board coordinates (1 to 8) and the part of
+// the atlas it shows
+struct square_instance_t
+{
+    GLfloat x, y;
+    uv_rect_t uv;
+};
+
+// Any number of squares of one size drawn by a single glDrawElementsInstanced.
+// Every square shows a rect of the same atlas, so nothing is bound or set
+// between squares and they blend in the order they were added.
+class square_batch
+{
+public:
+    square_batch(float size, texture atlas);
+    void clear() { instances.clear(); }
+    void add(uint8_t x, uint8_t y, uv_rect_t uv) { instances.push_back({GLfloat(x), GLfloat(y), uv}); }
+    const std::vector<square_instance_t> &squares() const { return instances; }
+    // uploads the squares added since clear() and draws them
+    void draw() const;
+
+private:
     vao VAO;
     square_vbo vbo;
-    square_ebo ebo;
     shader Shader;
-    texture tex;
-    void draw(uint8_t x = 1, uint8_t y = 1) const;
+    GLuint instance_buffer;
+    texture atlas;
+    std::vector<square_instance_t> instances;
+};
+
+// The squares of a batch rendered into an offscreen framebuffer of the
+// window's size and copied to the window every frame. The batch is only
+// drawn again when its squares differ from the ones last drawn.
+class cached_batch
+{
+public:
+    cached_batch(int width, int height, float size, texture atlas);
+    square_batch batch;
+    // redraws the framebuffer if the squares changed, true if it did
+    bool update();
+    // copies the framebuffer over the whole of the bound draw framebuffer
+    void blit() const;
+
+private:
+    int width, height;
+    GLuint fbo, colour;
+    std::vector<square_instance_t> drawn;
+    bool valid = false;
+};
+
+// GPU time spent between begin() and end(). Queries alternate between two
+// objects and are read a frame late, so reading never waits for the GPU.
+class gpu_timer
+{
+public:
+    gpu_timer();
+    void begin();
+    void end();
+    // the last measurement that has finished
+    float last_us() const { return last; }
+
+private:
+    GLuint queries[2];
+    bool pending[2] = {};
+    int current = 0;
+    float last = 0;
 };
 
-drawing_params setup_square(const void *image, int width, int height, float size, GLenum interpolation = GL_LINEAR);
\ No newline at end of file
+// draw calls and blits made through square_batch and cached_batch, the performance overlay reads and
+// resets it every frame
+extern unsigned draw_calls;
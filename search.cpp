@@ -0,0 +1,419 @@
+#include <cstdlib>
+#include "search.hpp"
+#include "trace.hpp"
+
+namespace
+{
+    constexpr int infinity = mate_score + 1;
+    // scores this close to mate_score are mates, endgame tables reach further than the search
+    constexpr int mate_window = max_ply + tb_max_plies;
+    // Syzygy wins without a distance to mate, below every mate and less the
+    // further they are from the root
+    constexpr int tb_win_score = mate_score - mate_window - 1;
+    constexpr int won_window = mate_window + 1 + max_ply;
+
+    // mate and table win scores are stored relative to the node so they stay valid at any ply
+    int score_to_tt(int score, int ply)
+    {
+        if (score > mate_score - won_window)
+            return score + ply;
+        if (score < -mate_score + won_window)
+            return score - ply;
+        return score;
+    }
+    int score_from_tt(int score, int ply)
+    {
+        if (score > mate_score - won_window)
+            return score - ply;
+        if (score < -mate_score + won_window)
+            return score + ply;
+        return score;
+    }
+
+    int move_order(const game_t &game, move_t m, move_t tt_move)
+    {
+        if (m == tt_move)
+            return 1 << 20;
+        int score = 0;
+        if (game.is_capture(m))
+        {
+            // most valuable victim, least valuable attacker. En passant takes a pawn.
+            piece_t victim = game.get(m.to);
+            int victim_value = victim ? piece_values[int(victim.get_type())] : piece_values[int(piece_type::pawn)];
+            score += (1 << 16) + victim_value * 16 - piece_values[int(game.get(m.from).get_type())] / 16;
+        }
+        if (m.promotion != piece_type::invalid)
+            score += (1 << 16) + piece_values[int(m.promotion)];
+        return score;
+    }
+
+    void order_moves(const game_t &game, std::vector<move_t> &moves, move_t tt_move)
+    {
+        std::vector<std::pair<int, move_t>> scored;
+        scored.reserve(moves.size());
+        for (move_t m : moves)
+            scored.emplace_back(move_order(game, m, tt_move), m);
+        std::stable_sort(scored.begin(), scored.end(), [](const auto &a, const auto &b)
+                         { return a.first > b.first; });
+        for (size_t i = 0; i < moves.size(); i++)
+            moves[i] = scored[i].second;
+    }
+}
+
+int64_t steady_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int evaluate(const game_t &game, pawn_table *pawn_cache, material_table *material_cache)
+{
+    CHESS_TRACE_SCOPE("evaluate");
+    material_entry_t material_computed;
+    if (!material_cache)
+        evaluate_material(game.material, material_computed);
+    const material_entry_t &material = material_cache ? material_cache->probe(game.material) : material_computed;
+    if (material.evaluate)
+    {
+        int score = material.evaluate(game, material.strong_white);
+        return game.white_turn ? score : -score;
+    }
+
+    uint64_t pawn_key = 0, pawn_bits[2] = {};
+    for (const auto &row : game.board)
+        for (const auto &piece : row)
+            if (piece.ispawn())
+            {
+                coordinate_t p = piece.get_position();
+                pawn_bits[piece.iswhite()] |= uint64_t(1) << ((p.y - 1) * 8 + p.x - 1);
+                pawn_key ^= zobrist_key(piece);
+            }
+
+    pawn_entry_t pawns_computed;
+    if (!pawn_cache)
+        evaluate_pawns(pawn_bits[1], pawn_bits[0], pawns_computed);
+    const pawn_entry_t &structure = pawn_cache ? pawn_cache->probe(pawn_key, pawn_bits[1], pawn_bits[0]) : pawns_computed;
+
+    // terms that differ between the opening and the ending are blended by the phase
+    int middlegame = structure.middlegame, endgame = structure.endgame;
+    int score = material.imbalance;
+    for (const auto &row : game.board)
+        for (const auto &piece : row)
+        {
+            if (piece.isinvalid())
+                continue;
+            coordinate_t p = piece.get_position();
+            bool white = piece.iswhite();
+            int sign = white ? 1 : -1;
+            // 1 on the piece's own back rank, 8 on the promotion rank
+            int rank = white ? p.y : 9 - p.y;
+            // king steps from the four centre squares, 0 to 3
+            int centre = std::max(std::abs(2 * p.x - 9), std::abs(2 * p.y - 9)) / 2;
+            uint64_t bit = uint64_t(1) << ((p.y - 1) * 8 + p.x - 1);
+            int value = piece_values[int(piece.get_type())];
+            switch (piece.get_type())
+            {
+            case piece_type::knight:
+                value += (3 - centre) * 12;
+                // an outpost no enemy pawn can ever chase away, guarded by an own pawn
+                if (rank >= 4 && rank <= 6 && !(structure.attack_span[!white] & bit) && (structure.attacks[white] & bit))
+                    value += 15;
+                break;
+            case piece_type::bishop:
+                value += (3 - centre) * 8;
+                break;
+            case piece_type::rook:
+                value += rank == 7 ? 20 : 0;
+                break;
+            case piece_type::queen:
+                value += (3 - centre) * 4;
+                break;
+            case piece_type::king:
+                endgame += sign * (3 - centre) * 15;
+                middlegame += sign * ((rank == 1 ? 20 : -10 * rank) + (rank <= 2 ? structure.shelter[white][p.x - 1] : 0));
+                break;
+            default:
+                break;
+            }
+            score += sign * value;
+        }
+    score += (middlegame * material.phase + endgame * (24 - material.phase)) / 24;
+
+    int scale = material.scale_function ? material.scale_function(game) : material.scale[score > 0];
+    score = score * scale / 64;
+    return game.white_turn ? score : -score;
+}
+
+transposition_table::transposition_table(size_t megabytes)
+{
+    size_t count = 1;
+    while (count * 2 * sizeof(tt_entry_t) <= megabytes * 1024 * 1024)
+        count *= 2;
+    entries.resize(count);
+}
+
+bool transposition_table::probe(uint64_t key, tt_entry_t &entry) const
+{
+    CHESS_TRACE_SCOPE("tt_probe");
+    const tt_entry_t &e = entries[key & (entries.size() - 1)];
+    if (e.bound == bound_t::none || e.key != key)
+        return false;
+    entry = e;
+    return true;
+}
+
+void transposition_table::store(uint64_t key, move_t move, int score, int depth, bound_t bound)
+{
+    tt_entry_t &e = entries[key & (entries.size() - 1)];
+    // keep a deeper result for the same position unless it is from an old search
+    if (e.key == key && e.age == age && e.depth > depth)
+        return;
+    if (move.isnull() && e.key == key)
+        move = e.move;
+    e = {key, move, int16_t(score), int8_t(depth), bound, age};
+}
+
+void transposition_table::clear()
+{
+    std::fill(entries.begin(), entries.end(), tt_entry_t());
+}
+
+int transposition_table::hashfull() const
+{
+    size_t sample = std::min<size_t>(1000, entries.size());
+    size_t used = 0;
+    for (size_t i = 0; i < sample; i++)
+        used += entries[i].bound != bound_t::none && entries[i].age == age;
+    return int(used * 1000 / sample);
+}
+
+bool searcher_t::probe_mate_table(const game_t &game, int ply, int &score)
+{
+    uint8_t value;
+    if (!tablebases || !tablebases->probe(game, value) || value == tb_invalid)
+        return false;
+    tb_hits++;
+    // distance to mate counts from this node, scores from the root
+    if (value == tb_draw)
+        score = 0;
+    else if (tb_wins(value))
+        score = mate_score - ply - tb_plies(value);
+    else
+        score = -mate_score + ply + tb_plies(value);
+    return true;
+}
+
+bool searcher_t::probe_tablebase(const game_t &game, int ply, int &score)
+{
+    if (probe_mate_table(game, ply, score))
+        return true;
+    // Syzygy WDL holds from a zeroed halfmove clock only, 50 move draws
+    // depend on the moves before
+    int wdl;
+    if (!tablebases || game.halfmove_clock != 0 || !tablebases->probe_wdl(game, wdl))
+        return false;
+    tb_hits++;
+    if (wdl == syzygy_win)
+        score = tb_win_score - ply;
+    else if (wdl == syzygy_loss)
+        score = -tb_win_score + ply;
+    else
+        // a cursed win is still a little better than a draw
+        score = wdl;
+    return true;
+}
+
+void searcher_t::filter_root_moves(const game_t &game)
+{
+    root_moves.clear();
+    int root_score;
+    if (!probe_mate_table(game, 0, root_score))
+    {
+        // Syzygy ranks the moves by the distance to the next zeroing move
+        if (tablebases && tablebases->probe_root(game, root_moves))
+            tb_hits++;
+        return;
+    }
+    // the quickest mate when winning, any draw when drawing, the slowest mate when losing
+    std::vector<move_t> moves = game.legal_moves();
+    int best = -infinity;
+    for (move_t m : moves)
+    {
+        game_t child = game;
+        child.play(m);
+        int score;
+        if (!probe_mate_table(child, 1, score))
+        {
+            // the move leads to a table that is not open
+            root_moves.clear();
+            return;
+        }
+        score = -score;
+        if (score > best)
+        {
+            best = score;
+            root_moves.clear();
+        }
+        if (score == best)
+            root_moves.push_back(m);
+    }
+}
+
+bool searcher_t::should_stop() const
+{
+    if (stop.load(std::memory_order_relaxed))
+        return true;
+    if (node_limit && nodes >= node_limit)
+        return true;
+    int64_t d = deadline.load(std::memory_order_relaxed);
+    return d && steady_ns() >= d;
+}
+
+search_info_t searcher_t::search(const game_t &game, const search_limits_t &limits,
+                                 const std::function<void(const search_info_t &)> &on_iteration)
+{
+    CHESS_TRACE_SCOPE("search");
+    auto start = std::chrono::steady_clock::now();
+    if (limits.time.count())
+        deadline = steady_ns() + std::chrono::duration_cast<std::chrono::nanoseconds>(limits.time).count();
+    nodes = tt_probes = tt_hits = tb_hits = 0;
+    pawns.probes = pawns.hits = 0;
+    material.probes = material.hits = 0;
+    node_limit = limits.nodes;
+    aborted = false;
+    filter_root_moves(game);
+
+    search_info_t info;
+    auto update_counters = [&]
+    {
+        info.nodes = nodes;
+        info.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        info.tt_probes = tt_probes;
+        info.tt_hits = tt_hits;
+        info.hashfull = tt.hashfull();
+        info.tb_hits = tb_hits;
+        info.pawn_probes = pawns.probes;
+        info.pawn_hits = pawns.hits;
+    };
+    for (int depth = 1; depth <= std::min(limits.depth, max_ply - 1); depth++)
+    {
+        CHESS_TRACE_SCOPE("iteration");
+        int score = negamax(game, depth, 0, -infinity, infinity);
+        // an unfinished iteration is thrown away, unless there is nothing else
+        if (aborted && !info.pv.empty())
+            break;
+        info.depth = depth;
+        info.score = score;
+        info.pv.assign(pv[0].begin(), pv[0].begin() + pv_length[0]);
+        if (aborted || info.pv.empty())
+            break;
+        update_counters();
+        if (on_iteration)
+            on_iteration(info);
+    }
+    update_counters();
+    return info;
+}
+
+int searcher_t::negamax(const game_t &game, int depth, int ply, int alpha, int beta)
+{
+    pv_length[ply] = ply;
+    if (depth <= 0)
+        return quiesce(game, ply, alpha, beta);
+    nodes++;
+    if (should_stop())
+    {
+        aborted = true;
+        return 0;
+    }
+
+    uint64_t key = game.hash();
+    tt_entry_t entry;
+    move_t tt_move;
+    tt_probes++;
+    if (tt.probe(key, entry))
+    {
+        tt_hits++;
+        tt_move = entry.move;
+        int score = score_from_tt(entry.score, ply);
+        if (ply > 0 && entry.depth >= depth &&
+            (entry.bound == bound_t::exact ||
+             (entry.bound == bound_t::lower && score >= beta) ||
+             (entry.bound == bound_t::upper && score <= alpha)))
+            return score;
+    }
+
+    int tb_score;
+    if (ply > 0 && probe_tablebase(game, ply, tb_score))
+        return tb_score;
+
+    std::vector<move_t> moves = ply == 0 && !root_moves.empty() ? root_moves : game.legal_moves();
+    if (moves.empty())
+        return game.in_check(game.white_turn) ? -mate_score + ply : 0;
+    if (ply >= max_ply - 1)
+        return evaluate(game, &pawns, &material);
+    order_moves(game, moves, tt_move);
+
+    int original_alpha = alpha;
+    int best = -infinity;
+    move_t best_move;
+    for (move_t m : moves)
+    {
+        game_t child = game;
+        child.play(m);
+        int score = -negamax(child, depth - 1, ply + 1, -beta, -alpha);
+        if (aborted)
+            return 0;
+        if (score <= best)
+            continue;
+        best = score;
+        best_move = m;
+        if (score <= alpha)
+            continue;
+        alpha = score;
+        pv[ply][ply] = m;
+        for (int i = ply + 1; i < pv_length[ply + 1]; i++)
+            pv[ply][i] = pv[ply + 1][i];
+        pv_length[ply] = std::max(pv_length[ply + 1], ply + 1);
+        if (alpha >= beta)
+            break;
+    }
+
+    bound_t bound = best >= beta ? bound_t::lower : best > original_alpha ? bound_t::exact
+                                                                          : bound_t::upper;
+    tt.store(key, best_move, score_to_tt(best, ply), depth, bound);
+    return best;
+}
+
+int searcher_t::quiesce(const game_t &game, int ply, int alpha, int beta)
+{
+    pv_length[ply] = ply;
+    nodes++;
+    if (should_stop())
+    {
+        aborted = true;
+        return 0;
+    }
+
+    int stand_pat = evaluate(game, &pawns, &material);
+    if (stand_pat >= beta || ply >= max_ply - 1)
+        return stand_pat;
+    alpha = std::max(alpha, stand_pat);
+
+    std::vector<move_t> moves = game.legal_moves();
+    moves.erase(std::remove_if(moves.begin(), moves.end(), [&](move_t m)
+                               { return !game.is_capture(m) && m.promotion != piece_type::queen; }),
+                moves.end());
+    order_moves(game, moves, move_t());
+    for (move_t m : moves)
+    {
+        game_t child = game;
+        child.play(m);
+        int score = -quiesce(child, ply + 1, -beta, -alpha);
+        if (aborted)
+            return 0;
+        if (score >= beta)
+            return score;
+        alpha = std::max(alpha, score);
+    }
+    return alpha;
+}
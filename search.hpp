@@ -0,0 +1,127 @@
+#pragma once
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "chess.hpp"
+#include "material.hpp"
+#include "pawns.hpp"
+#include "tablebase.hpp"
+
+constexpr int mate_score = 30000;
+constexpr int max_ply = 64;
+
+struct search_limits_t
+{
+    int depth = max_ply - 1;
+    // 0 means no limit
+    uint64_t nodes = 0;
+    std::chrono::milliseconds time{0};
+};
+
+struct search_info_t
+{
+    int depth = 0;
+    int score = 0;
+    uint64_t nodes = 0;
+    std::chrono::microseconds elapsed{0};
+    uint64_t tt_probes = 0;
+    uint64_t tt_hits = 0;
+    int hashfull = 0;
+    // positions answered by an endgame table, the root included
+    uint64_t tb_hits = 0;
+    // pawn structure evaluations found in the pawn hash
+    uint64_t pawn_probes = 0;
+    uint64_t pawn_hits = 0;
+    std::vector<move_t> pv;
+
+    uint64_t nps() const { return elapsed.count() ? nodes * 1000000 / elapsed.count() : 0; }
+};
+
+enum class bound_t : uint8_t
+{
+    none,
+    exact,
+    lower,
+    upper,
+};
+
+struct tt_entry_t
+{
+    uint64_t key = 0;
+    move_t move;
+    int16_t score = 0;
+    int8_t depth = 0;
+    bound_t bound = bound_t::none;
+    uint8_t age = 0;
+};
+
+class transposition_table
+{
+public:
+    explicit transposition_table(size_t megabytes = 16);
+    bool probe(uint64_t key, tt_entry_t &entry) const;
+    void store(uint64_t key, move_t move, int score, int depth, bound_t bound);
+    // entries from older searches are replaced first
+    void new_search() { age++; }
+    void clear();
+    // permille of the table written by the current search, sampled
+    int hashfull() const;
+
+private:
+    std::vector<tt_entry_t> entries;
+    uint8_t age = 0;
+};
+
+class searcher_t
+{
+public:
+    explicit searcher_t(transposition_table &tt) : tt(tt) {}
+    // iterative deepening, returns the last completed iteration. stop and
+    // deadline are left alone unless limits.time is set, callers reset them.
+    search_info_t search(const game_t &game, const search_limits_t &limits,
+                         const std::function<void(const search_info_t &)> &on_iteration = nullptr);
+
+    // both may be changed from other threads while a search runs
+    std::atomic<bool> stop{false};
+    // steady_clock nanoseconds at which the search stops, 0 for none
+    std::atomic<int64_t> deadline{0};
+    // tb-gen's distance to mate tables, probed below the root for exact scores
+    // and at the root to keep only the moves that hold the table's result.
+    // Syzygy tables in the set give win, draw or loss below the root and
+    // rank the root moves by DTZ. Only read, so searchers can share it.
+    const tablebase_set *tablebases = nullptr;
+
+private:
+    int negamax(const game_t &game, int depth, int ply, int alpha, int beta);
+    int quiesce(const game_t &game, int ply, int alpha, int beta);
+    bool should_stop() const;
+    bool probe_mate_table(const game_t &game, int ply, int &score);
+    bool probe_tablebase(const game_t &game, int ply, int &score);
+    void filter_root_moves(const game_t &game);
+
+    transposition_table &tt;
+    uint64_t nodes = 0;
+    uint64_t node_limit = 0;
+    uint64_t tt_probes = 0;
+    uint64_t tt_hits = 0;
+    uint64_t tb_hits = 0;
+    // kept between searches, pawn structures recur from move to move
+    pawn_table pawns;
+    material_table material;
+    bool aborted = false;
+    // moves searched at the root, all legal moves when empty
+    std::vector<move_t> root_moves;
+    // triangular principal variation table
+    std::array<std::array<move_t, max_ply>, max_ply> pv;
+    std::array<int, max_ply> pv_length;
+};
+
+// static evaluation in centipawns from the side to move's point of view. The
+// pawn structure and the material are looked up in the tables when given,
+// materials with an evaluator of their own skip the rest.
+int evaluate(const game_t &game, pawn_table *pawns = nullptr, material_table *material = nullptr);
+
+int64_t steady_ns();
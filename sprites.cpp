@@ -0,0 +1,102 @@
+#include <thread>
+#include "sprites.hpp"
+#include "assets.hpp"
+#include "search.hpp"
+#include "trace.hpp"
+
+namespace
+{
+    // the atlas laid out in memory, and the index of each image in it
+    struct packed_t
+    {
+        texture_atlas atlas;
+        int pieces[7][2] = {};
+        int light = 0, dark = 0, blue = 0, red = 0;
+    };
+
+    packed_t pack()
+    {
+        CHESS_TRACE_SCOPE("pack_sprites");
+        packed_t packed;
+        for (int type = 1; type < 7; type++)
+            for (bool white : {false, true})
+            {
+                const embedded_image_t *embedded = piece_image(piece_type(type), white);
+                assert(embedded);
+                image_view_t image = pixels(*embedded);
+                assert(image.pixels);
+                packed.pieces[type][white] = packed.atlas.add(image.pixels, image.width, image.height);
+            }
+        packed.light = packed.atlas.add({0xff, 0xff, 0xff, 0xff});
+        packed.dark = packed.atlas.add({0xd2, 0x69, 0x1e, 0xff});
+        packed.blue = packed.atlas.add({0x05, 0x10, 0xff, 0x88});
+        packed.red = packed.atlas.add({0xff, 0x00, 0x00, 0x88});
+        packed.atlas.pack();
+        return packed;
+    }
+
+    struct loader_t
+    {
+        std::thread thread;
+        bool started = false;
+        packed_t packed;
+        // joined here if the program exits before drawing anything
+        ~loader_t()
+        {
+            if (thread.joinable())
+                thread.join();
+        }
+    } loader;
+
+    void load()
+    {
+        CHESS_TRACE_THREAD("sprites");
+        loader.packed = pack();
+    }
+}
+
+void start_loading_sprites()
+{
+    if (loader.started)
+        return;
+    loader.started = true;
+    loader.thread = std::thread(load);
+}
+
+const sprites_t &sprites()
+{
+    static sprites_t sprites = []
+    {
+        start_loading_sprites();
+        int64_t start = steady_ns();
+        loader.thread.join();
+        packed_t &packed = loader.packed;
+
+        sprites_t sprites;
+        sprites.waited_ns = steady_ns() - start;
+        sprites.atlas = packed.atlas.upload();
+        for (int type = 1; type < 7; type++)
+            for (bool white : {false, true})
+                sprites.pieces[type][white] = packed.atlas.rect(packed.pieces[type][white]);
+        sprites.light = packed.atlas.rect(packed.light);
+        sprites.dark = packed.atlas.rect(packed.dark);
+        sprites.blue = packed.atlas.rect(packed.blue);
+        sprites.red = packed.atlas.rect(packed.red);
+        // the pixels are the driver's now
+        packed = packed_t();
+        return sprites;
+    }();
+    return sprites;
+}
+
+void add_board(square_batch &batch, const game_t &game)
+{
+    const sprites_t &s = sprites();
+    for (uint8_t x = 1; x <= 8; x++)
+        for (uint8_t y = 1; y <= 8; y++)
+            batch.add(x, y, (x + y) % 2 ? s.light : s.dark);
+    for (const auto &row : game.board)
+        for (const auto &piece : row)
+            if (!piece.isinvalid())
+                batch.add(piece.get_position().x, piece.get_position().y, s.pieces[int(piece.get_type())][piece.iswhite()]);
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include "rendering.hpp"
+#include "chess.hpp"
+
+// every image the board is drawn with, packed into one atlas
+struct sprites_t
+{
+    texture atlas;
+    // indexed by piece_type then colour
+    std::array<std::array<uv_rect_t, 2>, 7> pieces;
+    uv_rect_t light, dark, blue, red;
+    // how long sprites() waited for the worker to finish packing
+    int64_t waited_ns = 0;
+};
+
+// Decodes and packs the images into the atlas on a worker thread, so it can
+// run while the window and GL context are created. Only the first call starts
+// it.
+void start_loading_sprites();
+// waits for the worker, starting it if nothing did, and uploads the atlas the
+// first time it is asked for; needs the GL context
+const sprites_t &sprites();
+
+// the 64 squares, then every piece of the position
+void add_board(square_batch &batch, const game_t &game);
@@ -0,0 +1,939 @@
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <filesystem>
+#include "mapped_file.hpp"
+#include "syzygy.hpp"
+
+namespace
+{
+    constexpr int max_pieces = 7;
+
+    // piece codes in the files, pawn 1 knight 2 bishop 3 rook 4 queen 5
+    // king 6, black's 8 more. Indexed by piece_type.
+    constexpr uint8_t piece_codes[] = {0, 1, 4, 6, 3, 5, 2};
+    constexpr uint8_t black_code = 8;
+
+    enum : uint8_t
+    {
+        // which side to move a one sided .rtbz holds, set for black
+        flag_stm = 1,
+        flag_mapped = 2,
+        flag_win_plies = 4,
+        flag_loss_plies = 8,
+        flag_wide = 16,
+        flag_single_value = 128,
+    };
+
+    enum class probe_state
+    {
+        fail,
+        ok,
+        // a .rtbz holds the other side to move
+        change_stm,
+        // the best move captures or moves a pawn, the table is no help
+        zeroing_best_move,
+    };
+
+    uint16_t read16(const uint8_t *p) { return uint16_t(p[0] | p[1] << 8); }
+    uint32_t read32(const uint8_t *p) { return uint32_t(p[0] | p[1] << 8 | p[2] << 16 | uint32_t(p[3]) << 24); }
+    uint32_t read32_be(const uint8_t *p) { return uint32_t(uint32_t(p[0]) << 24 | p[1] << 16 | p[2] << 8 | p[3]); }
+    uint64_t read64_be(const uint8_t *p) { return uint64_t(read32_be(p)) << 32 | read32_be(p + 4); }
+
+    // the rank minus the file, 0 on the a1-h8 diagonal and negative below it
+    constexpr int off_diagonal(int square) { return (square >> 3) - (square & 7); }
+
+    struct maps_t
+    {
+        // pawn squares a2-h7 to 0..47, highest toward the a and h files and
+        // the lower ranks. The leading pawn is the highest.
+        int pawns[64] = {};
+        // squares below the a1-h8 diagonal to 0..27
+        int b1h1h7[64] = {};
+        // the a1-d1-d4 triangle to 0..9, the diagonal last
+        int a1d1d4[64] = {};
+        // the 462 king pairs with the first king on a1-d1-d4, by its a1d1d4
+        // code and the second king's square
+        int kk[10][64] = {};
+        // ways to choose k of n
+        int binomial[6][64] = {};
+        // start of the leading pawns' index when the first is on the square,
+        // by their count
+        int lead_pawn_index[6][64] = {};
+        // by leading pawn count and file a to d
+        int lead_pawns_size[6][4] = {};
+    };
+
+    constexpr maps_t make_maps()
+    {
+        maps_t m;
+        int code = 0;
+        for (int s = 0; s < 64; s++)
+            if (off_diagonal(s) < 0)
+                m.b1h1h7[s] = code++;
+
+        code = 0;
+        for (int s = 0; s <= 27; s++)
+            if (off_diagonal(s) < 0 && (s & 7) <= 3)
+                m.a1d1d4[s] = code++;
+        for (int s = 0; s <= 27; s++)
+            if (off_diagonal(s) == 0 && (s & 7) <= 3)
+                m.a1d1d4[s] = code++;
+
+        // pairs with both kings on the diagonal come last
+        code = 0;
+        for (int both = 0; both < 2; both++)
+            for (int idx = 0; idx < 10; idx++)
+                for (int s1 = 0; s1 <= 27; s1++)
+                {
+                    // b1 is the square coded 0, squares outside the triangle are too
+                    if (m.a1d1d4[s1] != idx || (!idx && s1 != 1))
+                        continue;
+                    for (int s2 = 0; s2 < 64; s2++)
+                    {
+                        int dx = (s1 & 7) - (s2 & 7), dy = (s1 >> 3) - (s2 >> 3);
+                        if (dx >= -1 && dx <= 1 && dy >= -1 && dy <= 1)
+                            continue;
+                        if (!off_diagonal(s1) && off_diagonal(s2) > 0)
+                            continue;
+                        if ((!off_diagonal(s1) && !off_diagonal(s2)) == bool(both))
+                            m.kk[idx][s2] = code++;
+                    }
+                }
+
+        m.binomial[0][0] = 1;
+        for (int n = 1; n < 64; n++)
+            for (int k = 0; k < 6 && k <= n; k++)
+                m.binomial[k][n] = (k > 0 ? m.binomial[k - 1][n - 1] : 0) + (k < n ? m.binomial[k][n - 1] : 0);
+
+        int available = 47;
+        for (int lead = 1; lead <= 5; lead++)
+            for (int file = 0; file < 4; file++)
+            {
+                int idx = 0;
+                for (int rank = 1; rank <= 6; rank++)
+                {
+                    int s = rank * 8 + file;
+                    if (lead == 1)
+                    {
+                        m.pawns[s] = available--;
+                        m.pawns[s ^ 7] = available--;
+                    }
+                    m.lead_pawn_index[lead][s] = idx;
+                    idx += m.binomial[lead - 1][m.pawns[s]];
+                }
+                m.lead_pawns_size[lead][file] = idx;
+            }
+        return m;
+    }
+
+    constexpr maps_t maps = make_maps();
+    static_assert(maps.kk[9][63] == 461 && maps.lead_pawns_size[1][0] == 6, "syzygy maps");
+
+    piece_type type_from_letter(char c)
+    {
+        switch (c)
+        {
+        case 'K':
+            return piece_type::king;
+        case 'Q':
+            return piece_type::queen;
+        case 'R':
+            return piece_type::rook;
+        case 'B':
+            return piece_type::bishop;
+        case 'N':
+            return piece_type::knight;
+        case 'P':
+            return piece_type::pawn;
+        default:
+            return piece_type::invalid;
+        }
+    }
+
+    // a win or loss the table says is one ply before the capture or pawn move
+    int dtz_before_zeroing(int wdl)
+    {
+        switch (wdl)
+        {
+        case syzygy_win:
+            return 1;
+        case syzygy_cursed_win:
+            return 101;
+        case syzygy_blessed_loss:
+            return -101;
+        case syzygy_loss:
+            return -1;
+        default:
+            return 0;
+        }
+    }
+
+    int sign_of(int value) { return (0 < value) - (value < 0); }
+
+    bool is_mate(const game_t &game)
+    {
+        return game.in_check(game.white_turn) && game.legal_moves().empty();
+    }
+}
+
+struct syzygy_table_t
+{
+    // Decoding data of one table in a file. A file has one per side to move
+    // and, with pawns, per file a to d of the leading pawn.
+    struct pairs_t
+    {
+        uint8_t flags = 0;
+        // Huffman code lengths in bits, or the value of a single value table
+        uint8_t max_sym_len = 0;
+        uint8_t min_sym_len = 0;
+        uint32_t blocks = 0;
+        size_t block_size = 0;
+        // a sparse index entry every span values
+        size_t span = 0;
+        // little endian uint16_t per code length, the symbol of the lowest code of that length
+        const uint8_t *lowest_sym = nullptr;
+        // three bytes per symbol, the two symbols it pairs or a value
+        const uint8_t *btree = nullptr;
+        // little endian uint16_t per block, the values in it minus one
+        const uint8_t *block_length = nullptr;
+        uint32_t block_length_size = 0;
+        // six bytes per entry, a block and the offset in it
+        const uint8_t *sparse_index = nullptr;
+        size_t sparse_index_size = 0;
+        const uint8_t *data = nullptr;
+        // by code length minus min_sym_len, the lowest code left aligned in 64 bits
+        std::vector<uint64_t> base64;
+        // values a symbol stands for, minus one
+        std::vector<uint8_t> symlen;
+        // the order the index takes the pieces in, split into groups of
+        // pieces encoded together
+        uint8_t pieces[max_pieces] = {};
+        uint64_t group_index[max_pieces + 1] = {};
+        int group_length[max_pieces + 1] = {};
+        // .rtbz value maps of wins, losses, cursed wins and blessed losses
+        uint16_t map_index[4] = {};
+    };
+
+    struct file_t
+    {
+        mapped_file file;
+        // [side to move][leading pawn file]
+        pairs_t pairs[2][4];
+        // .rtbz value maps
+        const uint8_t *map = nullptr;
+        bool open = false;
+    };
+
+    // game_t::material with the side named first as white, and as black
+    uint64_t key = 0;
+    uint64_t key2 = 0;
+    int pieces = 0;
+    bool pawns = false;
+    // a piece other than a king that is alone of its kind and colour
+    bool unique_pieces = false;
+    // the leading colour's pawns and the other's, the leading colour having
+    // pawns and no more than the other
+    uint8_t pawn_count[2] = {};
+    file_t wdl_file;
+    file_t dtz_file;
+
+    bool parse(const std::string &name);
+    bool open(file_t &f, const std::string &path, bool is_dtz);
+    bool set_groups(pairs_t &d, const int order[2], int file) const;
+    const uint8_t *set_sizes(pairs_t &d, const uint8_t *data, const uint8_t *end) const;
+
+    // the table in the file and the index in it
+    probe_state index(const game_t &game, bool is_dtz, const pairs_t *&table, int &file, uint64_t &idx) const;
+    probe_state probe(const game_t &game, bool is_dtz, int wdl, int &value) const;
+};
+
+bool syzygy_table_t::parse(const std::string &name)
+{
+    int counts[2][7] = {};
+    int side = 0;
+    for (char c : name)
+    {
+        if (c == 'v' && side == 0)
+        {
+            side = 1;
+            continue;
+        }
+        piece_type type = type_from_letter(c);
+        if (type == piece_type::invalid)
+            return false;
+        counts[side][int(type)]++;
+        key += material_unit(side == 0, type);
+        key2 += material_unit(side != 0, type);
+        pieces++;
+    }
+    int king = int(piece_type::king), pawn = int(piece_type::pawn);
+    if (side != 1 || pieces > max_pieces || counts[0][king] != 1 || counts[1][king] != 1)
+        return false;
+    pawns = counts[0][pawn] || counts[1][pawn];
+    for (const auto &count : counts)
+        for (int type = 1; type < 7; type++)
+            unique_pieces |= type != king && count[type] == 1;
+    bool first = !counts[1][pawn] || (counts[0][pawn] && counts[1][pawn] >= counts[0][pawn]);
+    pawn_count[0] = uint8_t(counts[first ? 0 : 1][pawn]);
+    pawn_count[1] = uint8_t(counts[first ? 1 : 0][pawn]);
+    return true;
+}
+
+// Groups are the pieces encoded together: the pawns of each colour, the
+// pieces of each kind and colour, and without pawns the first three pieces
+// or, with no piece alone of its kind, both kings. The order bytes say in
+// which order the groups make up the index. False if they leave a group out.
+bool syzygy_table_t::set_groups(pairs_t &d, const int order[2], int file) const
+{
+    int n = 0, first = pawns ? 0 : unique_pieces ? 3 : 2;
+    d.group_length[n] = 1;
+    for (int i = 1; i < pieces; i++)
+        if (--first > 0 || d.pieces[i] == d.pieces[i - 1])
+            d.group_length[n]++;
+        else
+            d.group_length[++n] = 1;
+    d.group_length[++n] = 0;
+
+    bool both_pawns = pawns && pawn_count[1];
+    int next = both_pawns ? 2 : 1;
+    int free = 64 - d.group_length[0] - (both_pawns ? d.group_length[1] : 0);
+    uint64_t idx = 1;
+    d.group_index[0] = 0;
+    for (int k = 0; next < n || k == order[0] || k == order[1]; k++)
+        if (k == order[0])
+        {
+            d.group_index[0] = idx;
+            idx *= pawns ? maps.lead_pawns_size[d.group_length[0]][file] : unique_pieces ? 31332 : 462;
+        }
+        else if (k == order[1])
+        {
+            d.group_index[1] = idx;
+            idx *= maps.binomial[d.group_length[1]][48 - d.group_length[0]];
+        }
+        else
+        {
+            d.group_index[next] = idx;
+            idx *= maps.binomial[d.group_length[next]][free];
+            free -= d.group_length[next++];
+        }
+    d.group_index[n] = idx;
+    return d.group_index[0] && (!both_pawns || d.group_index[1]);
+}
+
+namespace
+{
+    using pairs_t = syzygy_table_t::pairs_t;
+
+    uint16_t left_symbol(const pairs_t &d, int sym)
+    {
+        const uint8_t *lr = d.btree + 3 * sym;
+        return uint16_t((lr[1] & 0xf) << 8 | lr[0]);
+    }
+
+    // 0xfff for a symbol that is a value rather than a pair
+    uint16_t right_symbol(const pairs_t &d, int sym)
+    {
+        const uint8_t *lr = d.btree + 3 * sym;
+        return uint16_t(lr[2] << 4 | lr[1] >> 4);
+    }
+
+    uint8_t set_symlen(pairs_t &d, int sym, std::vector<bool> &visited)
+    {
+        visited[sym] = true;
+        int right = right_symbol(d, sym);
+        if (right == 0xfff)
+            return 0;
+        int left = left_symbol(d, sym);
+        if (!visited[left])
+            d.symlen[left] = set_symlen(d, left, visited);
+        if (!visited[right])
+            d.symlen[right] = set_symlen(d, right, visited);
+        return uint8_t(d.symlen[left] + d.symlen[right] + 1);
+    }
+
+    // The values are split into blocks of Huffman codes, each code a symbol
+    // that stands for one value or, by recursive pairing, two symbols.
+    int decompress(const pairs_t &d, uint64_t idx)
+    {
+        if (d.flags & flag_single_value)
+            return d.min_sym_len;
+
+        // the sparse index entry k has the block and offset of value k * span + span / 2
+        uint64_t k = idx / d.span;
+        const uint8_t *entry = d.sparse_index + 6 * k;
+        uint32_t block = read32(entry);
+        int offset = read16(entry + 4) + int(idx % d.span) - int(d.span / 2);
+        while (offset < 0)
+            offset += read16(d.block_length + 2 * --block) + 1;
+        while (offset > read16(d.block_length + 2 * block))
+            offset -= read16(d.block_length + 2 * block++) + 1;
+
+        const uint8_t *ptr = d.data + uint64_t(block) * d.block_size;
+        uint64_t buf64 = read64_be(ptr);
+        ptr += 8;
+        int buf64_size = 64;
+        int sym;
+        for (;;)
+        {
+            // codes of one length are consecutive, longer codes lower
+            int len = 0;
+            while (buf64 < d.base64[len])
+                len++;
+            sym = int((buf64 - d.base64[len]) >> (64 - len - d.min_sym_len));
+            sym += read16(d.lowest_sym + 2 * len);
+            if (offset < d.symlen[sym] + 1)
+                break;
+            offset -= d.symlen[sym] + 1;
+            len += d.min_sym_len;
+            buf64 <<= len;
+            buf64_size -= len;
+            if (buf64_size <= 32)
+            {
+                buf64_size += 32;
+                buf64 |= uint64_t(read32_be(ptr)) << (64 - buf64_size);
+                ptr += 4;
+            }
+        }
+        // the pairs a symbol expands into are adjacent values
+        while (d.symlen[sym])
+        {
+            int left = left_symbol(d, sym);
+            if (offset < d.symlen[left] + 1)
+                sym = left;
+            else
+            {
+                offset -= d.symlen[left] + 1;
+                sym = right_symbol(d, sym);
+            }
+        }
+        return left_symbol(d, sym);
+    }
+}
+
+const uint8_t *syzygy_table_t::set_sizes(pairs_t &d, const uint8_t *data, const uint8_t *end) const
+{
+    if (end - data < 2)
+        return nullptr;
+    d.flags = *data++;
+    if (d.flags & flag_single_value)
+    {
+        d.min_sym_len = *data++;
+        return data;
+    }
+    if (end - data < 9)
+        return nullptr;
+    // the last group index is the table's size
+    uint64_t size = d.group_index[std::find(d.group_length, d.group_length + max_pieces + 1, 0) - d.group_length];
+    d.block_size = size_t(1) << *data++;
+    d.span = size_t(1) << *data++;
+    d.sparse_index_size = size_t((size + d.span - 1) / d.span);
+    uint8_t padding = *data++;
+    d.blocks = read32(data);
+    data += 4;
+    d.block_length_size = d.blocks + padding;
+    d.max_sym_len = *data++;
+    d.min_sym_len = *data++;
+    // the codes are read from 64 bits refilled 32 at a time
+    if (d.min_sym_len == 0 || d.max_sym_len < d.min_sym_len || d.max_sym_len > 32)
+        return nullptr;
+    d.lowest_sym = data;
+    d.base64.assign(d.max_sym_len - d.min_sym_len + 1, 0);
+    if (end - data < ptrdiff_t(2 * d.base64.size() + 2))
+        return nullptr;
+    for (int i = int(d.base64.size()) - 2; i >= 0; i--)
+        d.base64[i] = (d.base64[i + 1] + read16(d.lowest_sym + 2 * i) - read16(d.lowest_sym + 2 * (i + 1))) / 2;
+    for (size_t i = 0; i < d.base64.size(); i++)
+        d.base64[i] <<= 64 - i - d.min_sym_len;
+    data += 2 * d.base64.size();
+
+    d.symlen.assign(read16(data), 0);
+    data += 2;
+    d.btree = data;
+    if (end - data < ptrdiff_t(3 * d.symlen.size()))
+        return nullptr;
+    for (size_t sym = 0; sym < d.symlen.size(); sym++)
+        if (right_symbol(d, int(sym)) != 0xfff &&
+            (left_symbol(d, int(sym)) >= d.symlen.size() || right_symbol(d, int(sym)) >= d.symlen.size()))
+            return nullptr;
+    std::vector<bool> visited(d.symlen.size());
+    for (size_t sym = 0; sym < d.symlen.size(); sym++)
+        if (!visited[sym])
+            d.symlen[sym] = set_symlen(d, int(sym), visited);
+    return data + 3 * d.symlen.size() + (d.symlen.size() & 1);
+}
+
+bool syzygy_table_t::open(file_t &f, const std::string &path, bool is_dtz)
+{
+    constexpr uint8_t magics[2][4] = {{0x71, 0xe8, 0x23, 0x5d}, {0xd7, 0x66, 0x0c, 0xa5}};
+    f.file = mapped_file(path.c_str());
+    const uint8_t *base = f.file.bytes(), *end = base + f.file.length();
+    if (!f.file.is_open() || f.file.length() < 6 || memcmp(base, magics[is_dtz], 4))
+        return false;
+    const uint8_t *data = base + 4;
+    // bit 0 both sides to move, bit 1 pawns
+    if (bool(*data & 1) != (key != key2) || bool(*data & 2) != pawns)
+        return false;
+    data++;
+
+    int sides = !is_dtz && key != key2 ? 2 : 1;
+    int files = pawns ? 4 : 1;
+    bool both_pawns = pawns && pawn_count[1];
+    // offsets from the mapping, which starts on a page
+    auto align = [&](const uint8_t *p, size_t to)
+    { return base + (size_t(p - base) + to - 1) / to * to; };
+
+    for (int file = 0; file < files; file++)
+    {
+        if (end - data < 1 + both_pawns + pieces)
+            return false;
+        int order[2][2] = {{data[0] & 0xf, both_pawns ? data[1] & 0xf : 0xf},
+                           {data[0] >> 4, both_pawns ? data[1] >> 4 : 0xf}};
+        data += 1 + both_pawns;
+        for (int k = 0; k < pieces; k++, data++)
+            for (int side = 0; side < sides; side++)
+                f.pairs[side][file].pieces[k] = uint8_t(side ? *data >> 4 : *data & 0xf);
+        for (int side = 0; side < sides; side++)
+            if (!set_groups(f.pairs[side][file], order[side], file))
+                return false;
+    }
+    data = align(data, 2);
+
+    for (int file = 0; file < files; file++)
+        for (int side = 0; side < sides; side++)
+            if (!(data = set_sizes(f.pairs[side][file], data, end)))
+                return false;
+
+    if (is_dtz)
+    {
+        f.map = data;
+        for (int file = 0; file < files; file++)
+        {
+            pairs_t &d = f.pairs[0][file];
+            if (!(d.flags & flag_mapped))
+                continue;
+            // lengths and values, for wins, losses, cursed wins and blessed losses
+            if (d.flags & flag_wide)
+            {
+                data = align(data, 2);
+                for (uint16_t &index : d.map_index)
+                {
+                    if (end - data < 2)
+                        return false;
+                    index = uint16_t((data - f.map) / 2 + 1);
+                    data += 2 * read16(data) + 2;
+                }
+            }
+            else
+                for (uint16_t &index : d.map_index)
+                {
+                    if (end - data < 1)
+                        return false;
+                    index = uint16_t(data - f.map + 1);
+                    data += *data + 1;
+                }
+        }
+        data = align(data, 2);
+    }
+
+    for (int file = 0; file < files; file++)
+        for (int side = 0; side < sides; side++)
+        {
+            pairs_t &d = f.pairs[side][file];
+            d.sparse_index = data;
+            data += 6 * d.sparse_index_size;
+        }
+    for (int file = 0; file < files; file++)
+        for (int side = 0; side < sides; side++)
+        {
+            pairs_t &d = f.pairs[side][file];
+            d.block_length = data;
+            data += 2 * size_t(d.block_length_size);
+        }
+    for (int file = 0; file < files; file++)
+        for (int side = 0; side < sides; side++)
+        {
+            pairs_t &d = f.pairs[side][file];
+            data = align(data, 64);
+            d.data = data;
+            data += uint64_t(d.blocks) * d.block_size;
+        }
+    f.open = data <= end;
+    return f.open;
+}
+
+// The stronger side is taken as white and the board reflected the way the
+// table expects, then the pieces are counted off group by group.
+probe_state syzygy_table_t::index(const game_t &game, bool is_dtz, const pairs_t *&table, int &file, uint64_t &idx) const
+{
+    const file_t &f = is_dtz ? dtz_file : wdl_file;
+    if (!f.open)
+        return probe_state::fail;
+
+    // the table stores the stronger side as white, and only white to move
+    // when both sides have the same pieces
+    bool flip = game.material != key || (key == key2 && !game.white_turn);
+    uint8_t flip_colour = flip ? black_code : 0, flip_squares = flip ? 56 : 0;
+    int stm = flip == game.white_turn;
+
+    uint8_t squares[max_pieces], codes[max_pieces];
+    int size = 0, lead_pawns = 0;
+    file = 0;
+    uint8_t lead_code = pawns ? uint8_t(f.pairs[0][0].pieces[0] ^ flip_colour) : 0;
+    // the leading pawns first, the rest after, each in board order
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (uint8_t y = 1; y <= 8; y++)
+            for (uint8_t x = 1; x <= 8; x++)
+            {
+                piece_t piece = game.get(x, y);
+                if (piece.isinvalid())
+                    continue;
+                uint8_t code = uint8_t(piece_codes[int(piece.get_type())] | (piece.iswhite() ? 0 : black_code));
+                if ((code == lead_code) != (pass == 0))
+                    continue;
+                squares[size] = uint8_t(((y - 1) * 8 + x - 1) ^ flip_squares);
+                codes[size++] = uint8_t(code ^ flip_colour);
+            }
+        if (pass == 0)
+            lead_pawns = size;
+    }
+    if (lead_pawns)
+    {
+        // the leading pawn is the one nearest the a or h file, then the lowest
+        std::swap(squares[0], *std::max_element(squares, squares + lead_pawns, [](uint8_t a, uint8_t b)
+                                                { return maps.pawns[a] < maps.pawns[b]; }));
+        file = squares[0] & 7;
+        if (file > 3)
+            file = 7 - file;
+    }
+
+    // a one sided .rtbz answers the other side to move through a search
+    if (is_dtz && (f.pairs[0][file].flags & flag_stm) != stm && (key != key2 || pawns))
+        return probe_state::change_stm;
+
+    const pairs_t &d = f.pairs[is_dtz || key == key2 ? 0 : stm][file];
+    table = &d;
+    // the order the table takes the pieces in
+    for (int i = lead_pawns; i < size - 1; i++)
+        for (int j = i + 1; j < size; j++)
+            if (d.pieces[i] == codes[j])
+            {
+                std::swap(codes[i], codes[j]);
+                std::swap(squares[i], squares[j]);
+                break;
+            }
+
+    if ((squares[0] & 7) > 3)
+        for (int i = 0; i < size; i++)
+            squares[i] ^= 7;
+
+    if (pawns)
+    {
+        idx = uint64_t(maps.lead_pawn_index[lead_pawns][squares[0]]);
+        std::stable_sort(squares + 1, squares + lead_pawns, [](uint8_t a, uint8_t b)
+                         { return maps.pawns[a] < maps.pawns[b]; });
+        for (int i = 1; i < lead_pawns; i++)
+            idx += uint64_t(maps.binomial[i][maps.pawns[squares[i]]]);
+    }
+    else
+    {
+        if ((squares[0] >> 3) > 3)
+            for (int i = 0; i < size; i++)
+                squares[i] ^= 56;
+        // the first leading piece off the diagonal goes below it
+        for (int i = 0; i < d.group_length[0]; i++)
+        {
+            if (!off_diagonal(squares[i]))
+                continue;
+            if (off_diagonal(squares[i]) > 0)
+                for (int j = i; j < size; j++)
+                    squares[j] = uint8_t((squares[j] >> 3 | squares[j] << 3) & 63);
+            break;
+        }
+
+        if (unique_pieces)
+        {
+            int s0 = squares[0], s1 = squares[1], s2 = squares[2];
+            int adjust1 = s1 > s0, adjust2 = (s2 > s0) + (s2 > s1);
+            // the first piece below the diagonal, or the first on it and the
+            // second below, the first two on it, or all three
+            if (off_diagonal(s0))
+                idx = uint64_t((maps.a1d1d4[s0] * 63 + (s1 - adjust1)) * 62 + s2 - adjust2);
+            else if (off_diagonal(s1))
+                idx = uint64_t((6 * 63 + (s0 >> 3) * 28 + maps.b1h1h7[s1]) * 62 + s2 - adjust2);
+            else if (off_diagonal(s2))
+                idx = uint64_t(6 * 63 * 62 + 4 * 28 * 62 + (s0 >> 3) * 7 * 28 + ((s1 >> 3) - adjust1) * 28 +
+                               maps.b1h1h7[s2]);
+            else
+                idx = uint64_t(6 * 63 * 62 + 4 * 28 * 62 + 4 * 7 * 28 + (s0 >> 3) * 7 * 6 + ((s1 >> 3) - adjust1) * 6 +
+                               ((s2 >> 3) - adjust2));
+        }
+        else
+            idx = uint64_t(maps.kk[maps.a1d1d4[squares[0]]][squares[1]]);
+    }
+
+    // every further group counts the squares the groups before it leave free
+    idx *= d.group_index[0];
+    int start = d.group_length[0];
+    bool remaining_pawns = pawns && pawn_count[1];
+    for (int next = 1; d.group_length[next]; next++)
+    {
+        int length = d.group_length[next];
+        std::stable_sort(squares + start, squares + start + length);
+        uint64_t n = 0;
+        for (int i = 0; i < length; i++)
+        {
+            int adjust = int(std::count_if(squares, squares + start, [&](uint8_t s)
+                                           { return squares[start + i] > s; }));
+            n += uint64_t(maps.binomial[i + 1][squares[start + i] - adjust - 8 * remaining_pawns]);
+        }
+        remaining_pawns = false;
+        idx += n * d.group_index[next];
+        start += length;
+    }
+    return probe_state::ok;
+}
+
+probe_state syzygy_table_t::probe(const game_t &game, bool is_dtz, int wdl, int &value) const
+{
+    const pairs_t *d;
+    int file;
+    uint64_t idx;
+    probe_state state = index(game, is_dtz, d, file, idx);
+    if (state != probe_state::ok)
+        return state;
+    value = decompress(*d, idx);
+    if (!is_dtz)
+    {
+        value -= 2;
+        return probe_state::ok;
+    }
+
+    // .rtbz values are ranks by frequency when mapped, in moves unless the
+    // flags say plies
+    const pairs_t &first = dtz_file.pairs[0][file];
+    if (first.flags & flag_mapped)
+    {
+        constexpr int map_of_wdl[] = {1, 3, 0, 2, 0};
+        int at = first.map_index[map_of_wdl[wdl + 2]] + value;
+        value = first.flags & flag_wide ? read16(dtz_file.map + 2 * at) : dtz_file.map[at];
+    }
+    if ((wdl == syzygy_win && !(first.flags & flag_win_plies)) ||
+        (wdl == syzygy_loss && !(first.flags & flag_loss_plies)) || wdl == syzygy_cursed_win ||
+        wdl == syzygy_blessed_loss)
+        value *= 2;
+    value++;
+    return probe_state::ok;
+}
+
+namespace
+{
+    using table_map = std::unordered_map<uint64_t, const syzygy_table_t *>;
+
+    constexpr uint64_t bare_kings = material_unit(true, piece_type::king) + material_unit(false, piece_type::king);
+
+    probe_state probe_table(const table_map &tables, const game_t &game, bool is_dtz, int wdl, int &value)
+    {
+        if (game.material == bare_kings)
+        {
+            value = syzygy_draw;
+            return probe_state::ok;
+        }
+        auto found = tables.find(game.material);
+        if (found == tables.end())
+            return probe_state::fail;
+        return found->second->probe(game, is_dtz, wdl, value);
+    }
+
+    // Tables leave out positions in which the side to move wins by a capture,
+    // and may store a loss where a capture draws. So the captures, and with
+    // `zeroing` the pawn moves, are searched as well and the best result
+    // taken. The state says whether that best result came from such a move.
+    int search(const table_map &tables, const game_t &game, bool zeroing, probe_state &state)
+    {
+        std::vector<move_t> moves = game.legal_moves();
+        int best = syzygy_loss;
+        size_t searched = 0;
+        for (move_t m : moves)
+        {
+            if (!game.is_capture(m) && (!zeroing || !game.get(m.from).ispawn()))
+                continue;
+            searched++;
+            game_t child = game;
+            child.play(m);
+            int value = -search(tables, child, false, state);
+            if (state == probe_state::fail)
+                return syzygy_draw;
+            if (value > best)
+            {
+                best = value;
+                if (value >= syzygy_win)
+                {
+                    state = probe_state::zeroing_best_move;
+                    return value;
+                }
+            }
+        }
+
+        // with nothing but captures the table is not needed, and may be
+        // wrong as it ignores en passant
+        bool all_searched = searched && searched == moves.size();
+        int value = best;
+        if (!all_searched)
+        {
+            state = probe_table(tables, game, false, 0, value);
+            if (state == probe_state::fail)
+                return syzygy_draw;
+        }
+        if (best >= value)
+        {
+            state = best > syzygy_draw || all_searched ? probe_state::zeroing_best_move : probe_state::ok;
+            return best;
+        }
+        state = probe_state::ok;
+        return value;
+    }
+
+    int probe_dtz(const table_map &tables, const game_t &game, probe_state &state)
+    {
+        int wdl = search(tables, game, true, state);
+        if (state == probe_state::fail || wdl == syzygy_draw)
+            return 0;
+        // the table has nothing to say when the best move zeroes the clock
+        if (state == probe_state::zeroing_best_move)
+            return dtz_before_zeroing(wdl);
+
+        int dtz;
+        state = probe_table(tables, game, true, wdl, dtz);
+        if (state == probe_state::fail)
+            return 0;
+        if (state != probe_state::change_stm)
+            return (dtz + 100 * (wdl == syzygy_blessed_loss || wdl == syzygy_cursed_win)) * sign_of(wdl);
+
+        // the file holds the other side to move, so look one move ahead for
+        // the winning move that zeroes soonest
+        int best = INT_MAX;
+        for (move_t m : game.legal_moves())
+        {
+            bool zeroing = game.is_capture(m) || game.get(m.from).ispawn();
+            game_t child = game;
+            child.play(m);
+            // a zeroing move counts from before it, and only the sign of what follows matters
+            dtz = zeroing ? -dtz_before_zeroing(search(tables, child, false, state)) : -probe_dtz(tables, child, state);
+            if (state == probe_state::fail)
+                return 0;
+            if (dtz == 1 && is_mate(child))
+                best = 1;
+            if (!zeroing)
+                dtz += sign_of(dtz);
+            if (dtz < best && sign_of(dtz) == sign_of(wdl))
+                best = dtz;
+        }
+        // no legal moves, mated
+        return best == INT_MAX ? -1 : best;
+    }
+}
+
+syzygy_tables::syzygy_tables() = default;
+syzygy_tables::~syzygy_tables() = default;
+
+size_t syzygy_tables::open_directory(const std::string &directory)
+{
+    std::error_code error;
+    for (const auto &entry : std::filesystem::directory_iterator(directory, error))
+    {
+        if (entry.path().extension() != ".rtbw")
+            continue;
+        auto table = std::make_unique<syzygy_table_t>();
+        if (!table->parse(entry.path().stem().string()) || by_key.count(table->key) ||
+            !table->open(table->wdl_file, entry.path().string(), false))
+            continue;
+        std::filesystem::path dtz = entry.path();
+        table->open(table->dtz_file, dtz.replace_extension(".rtbz").string(), true);
+        by_key[table->key] = table.get();
+        by_key[table->key2] = table.get();
+        pieces = std::max(pieces, table->pieces);
+        tables.push_back(std::move(table));
+    }
+    return tables.size();
+}
+
+bool syzygy_tables::covers(const game_t &game) const
+{
+    if (game.castling_rights())
+        return false;
+    return by_key.count(game.material) || (game.material == bare_kings && !by_key.empty());
+}
+
+bool syzygy_tables::probe_wdl(const game_t &game, int &wdl) const
+{
+    if (!covers(game))
+        return false;
+    probe_state state = probe_state::ok;
+    wdl = search(by_key, game, false, state);
+    return state != probe_state::fail;
+}
+
+bool syzygy_tables::probe_dtz(const game_t &game, int &dtz) const
+{
+    if (!covers(game))
+        return false;
+    probe_state state = probe_state::ok;
+    dtz = ::probe_dtz(by_key, game, state);
+    return state != probe_state::fail;
+}
+
+bool syzygy_tables::probe_root(const game_t &game, std::vector<move_t> &moves) const
+{
+    moves.clear();
+    if (!covers(game))
+        return false;
+    std::vector<move_t> legal = game.legal_moves();
+    int clock = int(game.halfmove_clock);
+    // the rank of a move, INT_MIN when a probe fails
+    auto rank = [&](move_t m, bool by_dtz)
+    {
+        game_t child = game;
+        child.play(m);
+        int wdl, dtz;
+        if (!probe_wdl(child, wdl))
+            return INT_MIN;
+        if (!by_dtz)
+            return -wdl;
+        if (child.halfmove_clock == 0)
+            dtz = dtz_before_zeroing(-wdl);
+        else if (!probe_dtz(child, dtz))
+            return INT_MIN;
+        else
+            dtz = is_mate(child) ? 1 : -dtz + sign_of(-dtz);
+        // wins that zero the clock soonest first, then losses that last
+        // past the 50 move rule
+        if (dtz > 0)
+            return 1000 - (dtz + clock);
+        if (dtz < 0)
+            return -dtz + clock <= 100 ? -1000 : -1000 + (-dtz + clock);
+        return 0;
+    };
+    // by WDL alone when the .rtbz files are missing
+    std::vector<int> ranks;
+    bool failed = true;
+    for (bool by_dtz : {true, false})
+    {
+        ranks.clear();
+        for (move_t m : legal)
+            ranks.push_back(rank(m, by_dtz));
+        failed = std::count(ranks.begin(), ranks.end(), INT_MIN) != 0;
+        if (!failed)
+            break;
+    }
+    if (failed)
+        return false;
+    int best = INT_MIN;
+    for (int r : ranks)
+        best = std::max(best, r);
+    for (size_t i = 0; i < legal.size(); i++)
+        if (ranks[i] == best)
+            moves.push_back(legal[i]);
+    return !moves.empty();
+}
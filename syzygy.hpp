@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "chess.hpp"
+
+// Syzygy endgame tables: .rtbw files hold win, draw or loss and .rtbz files
+// the distance to the next capture or pawn move, both compressed. They are
+// read in place through memory mappings. Every file is mapped and its
+// header parsed when the directory is opened, so probing only reads and
+// threads can share the tables.
+
+// for the side to move, with the 50 move rule: a cursed win is a win only
+// without it, a blessed loss a loss only without it
+constexpr int syzygy_loss = -2;
+constexpr int syzygy_blessed_loss = -1;
+constexpr int syzygy_draw = 0;
+constexpr int syzygy_cursed_win = 1;
+constexpr int syzygy_win = 2;
+
+struct syzygy_table_t;
+
+class syzygy_tables
+{
+public:
+    syzygy_tables();
+    ~syzygy_tables();
+
+    // opens every .rtbw in the directory with its .rtbz when there is one,
+    // returns how many endings are open in all
+    size_t open_directory(const std::string &directory);
+    size_t size() const { return tables.size(); }
+    bool empty() const { return tables.empty(); }
+    // most pieces on the board of an open ending
+    int max_pieces() const { return pieces; }
+
+    // One of syzygy_loss to syzygy_win. False with castling rights or when a
+    // table this or a capture from here needs is not open.
+    bool probe_wdl(const game_t &game, int &wdl) const;
+    // Plies to the next capture or pawn move along the quickest winning or
+    // slowest losing line, negative when losing and 0 for a draw. Above 100
+    // in size for cursed wins and blessed losses. Counts from a halfmove
+    // clock of 0, callers add the moves already played. Also false when the
+    // .rtbz is missing.
+    bool probe_dtz(const game_t &game, int &dtz) const;
+    // Keeps the legal moves that hold the best result: by DTZ and the
+    // halfmove clock so a win is not lost to the 50 move rule, or by WDL
+    // alone without the .rtbz files. False if a move leaves the open tables.
+    bool probe_root(const game_t &game, std::vector<move_t> &moves) const;
+
+private:
+    // an open ending or bare kings, without castling rights
+    bool covers(const game_t &game) const;
+
+    std::vector<std::unique_ptr<syzygy_table_t>> tables;
+    // by game_t::material, both colourings of every ending
+    std::unordered_map<uint64_t, const syzygy_table_t *> by_key;
+    int pieces = 0;
+};
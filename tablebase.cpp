@@ -0,0 +1,432 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include "tablebase.hpp"
+
+namespace
+{
+    constexpr char magic[8] = {'C', 'H', 'T', 'B', '0', '0', '0', '2'};
+    // magic, material name and entry count
+    constexpr size_t header_size = 32;
+    constexpr size_t name_size = 16;
+
+    // order within a side, indexed by piece_type
+    constexpr int rank_of[] = {6, 5, 2, 0, 3, 1, 4};
+    // indexed by piece_type
+    constexpr char letters[] = "?PRKBQN";
+
+    piece_type type_from_letter(char c)
+    {
+        for (int type = 1; type <= 6; type++)
+            if (letters[type] == c)
+                return piece_type(type);
+        return piece_type::invalid;
+    }
+
+    struct side_t
+    {
+        tb_piece_t pieces[tb_max_pieces];
+        int count = 0;
+
+        void sort()
+        {
+            std::stable_sort(pieces, pieces + count, [](const tb_piece_t &a, const tb_piece_t &b)
+                             { return rank_of[int(a.type)] < rank_of[int(b.type)]; });
+        }
+        int kings() const
+        {
+            return int(std::count_if(pieces, pieces + count, [](const tb_piece_t &p)
+                                     { return p.type == piece_type::king; }));
+        }
+    };
+
+    // more pieces, or the same number and the first that differs is worth more
+    bool stronger(const side_t &a, const side_t &b)
+    {
+        if (a.count != b.count)
+            return a.count > b.count;
+        for (int i = 0; i < a.count; i++)
+            if (a.pieces[i].type != b.pieces[i].type)
+                return rank_of[int(a.pieces[i].type)] < rank_of[int(b.pieces[i].type)];
+        return false;
+    }
+
+    bool normalise(side_t white, side_t black, bool white_turn, tb_material_t &material, tb_position_t &position)
+    {
+        if (white.count + black.count > tb_max_pieces || white.kings() != 1 || black.kings() != 1)
+            return false;
+        white.sort();
+        black.sort();
+        bool flip = stronger(black, white);
+        const side_t &first = flip ? black : white, &second = flip ? white : black;
+        material.count = 0;
+        for (const side_t *side : {&first, &second})
+            for (int i = 0; i < side->count; i++)
+            {
+                material.types[material.count] = side->pieces[i].type;
+                material.white[material.count] = side == &first;
+                // swapping colours mirrors the ranks
+                position.squares[material.count] = flip ? side->pieces[i].square ^ 56 : side->pieces[i].square;
+                material.count++;
+            }
+        position.white_turn = flip ? !white_turn : white_turn;
+        return true;
+    }
+
+    // The reflection that puts the white king on a1-d1-d4, or on files a-d
+    // with pawns on the board. Without pawns and with that king on the a1-h8
+    // diagonal, it also puts the black king on or below the diagonal.
+    struct symmetry_t
+    {
+        uint8_t mirror = 0;
+        bool transpose = false;
+
+        constexpr uint8_t apply(uint8_t square) const
+        {
+            square ^= mirror;
+            return transpose ? uint8_t((square & 7) << 3 | square >> 3) : square;
+        }
+    };
+
+    constexpr symmetry_t symmetry(bool pawns, uint8_t white_king, uint8_t black_king)
+    {
+        symmetry_t s;
+        if ((white_king & 7) >= 4)
+            s.mirror |= 7;
+        if (pawns)
+            return s;
+        if ((white_king >> 3) >= 4)
+            s.mirror |= 56;
+        uint8_t white = white_king ^ s.mirror, black = black_king ^ s.mirror;
+        s.transpose = (white >> 3) > (white & 7) || ((white >> 3) == (white & 7) && (black >> 3) > (black & 7));
+        return s;
+    }
+
+    // Both kings as one index, counting only pairs the symmetry leaves as
+    // they are and on which the kings do not touch: 462 without pawns, 1806
+    // with them.
+    struct king_pairs_t
+    {
+        // -1 for the pairs left out
+        int16_t index[64][64] = {};
+        uint8_t squares[1806][2] = {};
+        int count = 0;
+    };
+
+    constexpr king_pairs_t make_king_pairs(bool pawns)
+    {
+        king_pairs_t pairs;
+        for (int white = 0; white < 64; white++)
+            for (int black = 0; black < 64; black++)
+            {
+                int dx = (white & 7) - (black & 7), dy = (white >> 3) - (black >> 3);
+                symmetry_t s = symmetry(pawns, uint8_t(white), uint8_t(black));
+                bool touching = dx >= -1 && dx <= 1 && dy >= -1 && dy <= 1;
+                pairs.index[white][black] = int16_t(touching || s.mirror || s.transpose ? -1 : pairs.count);
+                if (pairs.index[white][black] < 0)
+                    continue;
+                pairs.squares[pairs.count][0] = uint8_t(white);
+                pairs.squares[pairs.count][1] = uint8_t(black);
+                pairs.count++;
+            }
+        return pairs;
+    }
+
+    // indexed by whether there are pawns
+    constexpr king_pairs_t king_pairs[2] = {make_king_pairs(false), make_king_pairs(true)};
+    static_assert(king_pairs[0].count == 462 && king_pairs[1].count == 1806, "king pair counts");
+
+    // The order the index takes the pieces in: both kings, then the pawns,
+    // then the rest. Returns the number of pawns.
+    int index_order(const tb_material_t &material, int *slots)
+    {
+        int n = 0, pawns = 0;
+        slots[n++] = 0;
+        for (int slot = 1; slot < material.count; slot++)
+            if (material.types[slot] == piece_type::king)
+                slots[n++] = slot;
+        for (int slot = 1; slot < material.count; slot++)
+            if (material.types[slot] == piece_type::pawn)
+            {
+                slots[n++] = slot;
+                pawns++;
+            }
+        for (int slot = 1; slot < material.count; slot++)
+            if (material.types[slot] != piece_type::king && material.types[slot] != piece_type::pawn)
+                slots[n++] = slot;
+        return pawns;
+    }
+}
+
+bool tb_material_t::parse(std::string_view name, tb_material_t &material)
+{
+    side_t sides[2];
+    int side = 0;
+    for (char c : name)
+    {
+        if (c == 'v' && side == 0)
+        {
+            side = 1;
+            continue;
+        }
+        piece_type type = type_from_letter(c);
+        if (type == piece_type::invalid || sides[side].count == tb_max_pieces)
+            return false;
+        sides[side].pieces[sides[side].count++] = {type, side == 0, 0};
+    }
+    tb_position_t unused;
+    return side == 1 && normalise(sides[0], sides[1], true, material, unused);
+}
+
+std::string tb_material_t::name() const
+{
+    std::string name;
+    for (int i = 0; i < count; i++)
+    {
+        if (i && !white[i] && white[i - 1])
+            name += 'v';
+        name += letters[int(types[i])];
+    }
+    return name;
+}
+
+uint64_t tb_material_t::key(bool swapped) const
+{
+    uint64_t key = 0;
+    for (int i = 0; i < count; i++)
+        key += material_unit(white[i] != swapped, types[i]);
+    return key;
+}
+
+bool tb_material_t::has_pawns() const
+{
+    return std::find(types, types + count, piece_type::pawn) != types + count;
+}
+
+uint64_t tb_material_t::size() const
+{
+    int slots[tb_max_pieces];
+    int pawns = index_order(*this, slots);
+    uint64_t size = uint64_t(king_pairs[pawns > 0].count) * 2;
+    for (int i = 2; i < count; i++)
+        size *= i < 2 + pawns ? 48 - (i - 2) : 64 - i;
+    return size;
+}
+
+bool tb_normalise(const tb_piece_t *pieces, int count, bool white_turn, tb_material_t &material,
+                  tb_position_t &position)
+{
+    side_t white, black;
+    for (int i = 0; i < count; i++)
+    {
+        side_t &side = pieces[i].white ? white : black;
+        if (side.count == tb_max_pieces)
+            return false;
+        side.pieces[side.count++] = pieces[i];
+    }
+    return normalise(white, black, white_turn, material, position);
+}
+
+uint64_t tb_index(const tb_material_t &material, tb_position_t position)
+{
+    int slots[tb_max_pieces];
+    int pawns = index_order(material, slots);
+    symmetry_t s = symmetry(pawns > 0, position.squares[slots[0]], position.squares[slots[1]]);
+    uint8_t squares[tb_max_pieces];
+    // with both kings on the diagonal the first piece off it decides, so every
+    // reflection of a position has the same index
+    auto on_diagonal = [](uint8_t square) { return (square >> 3) == (square & 7); };
+    if (!pawns && on_diagonal(s.apply(position.squares[slots[0]])) && on_diagonal(s.apply(position.squares[slots[1]])))
+        for (int i = 2; i < material.count; i++)
+        {
+            uint8_t square = s.apply(position.squares[slots[i]]);
+            if (!on_diagonal(square))
+            {
+                s.transpose = (square >> 3) > (square & 7);
+                break;
+            }
+        }
+    uint64_t occupied = 0;
+    for (int i = 0; i < material.count; i++)
+    {
+        squares[i] = s.apply(position.squares[slots[i]]);
+        if (occupied & (1ull << squares[i]))
+            return tb_no_index;
+        occupied |= 1ull << squares[i];
+    }
+    int kings = king_pairs[pawns > 0].index[squares[0]][squares[1]];
+    if (kings < 0)
+        return tb_no_index;
+    uint64_t index = uint64_t(kings);
+    // each square counts only the squares the pieces before it left free
+    for (int i = 2; i < material.count; i++)
+    {
+        bool pawn = i < 2 + pawns;
+        int first = pawn ? 2 : 0, square = pawn ? squares[i] - 8 : squares[i];
+        if (square < 0 || square >= (pawn ? 48 : 64))
+            return tb_no_index;
+        int free = square;
+        for (int j = first; j < i; j++)
+            free -= squares[j] < squares[i];
+        index = index * uint64_t(pawn ? 48 - (i - 2) : 64 - i) + uint64_t(free);
+    }
+    return index * 2 + !position.white_turn;
+}
+
+bool tb_decode(const tb_material_t &material, uint64_t index, tb_position_t &position)
+{
+    int slots[tb_max_pieces];
+    int pawns = index_order(material, slots);
+    uint64_t whole = index;
+    position.white_turn = !(index & 1);
+    index >>= 1;
+    int free[tb_max_pieces];
+    for (int i = material.count - 1; i >= 2; i--)
+    {
+        uint64_t range = i < 2 + pawns ? 48 - (i - 2) : 64 - i;
+        free[i] = int(index % range);
+        index /= range;
+    }
+    const king_pairs_t &pairs = king_pairs[pawns > 0];
+    uint8_t squares[tb_max_pieces] = {pairs.squares[index][0], pairs.squares[index][1]};
+    for (int i = 2; i < material.count; i++)
+    {
+        // steps over the squares taken before it, lowest first
+        bool pawn = i < 2 + pawns;
+        int first = pawn ? 2 : 0, square = free[i] + (pawn ? 8 : 0);
+        uint8_t taken[tb_max_pieces];
+        std::copy(squares + first, squares + i, taken);
+        std::sort(taken, taken + (i - first));
+        for (int j = 0; j < i - first; j++)
+            square += taken[j] <= square;
+        squares[i] = uint8_t(square);
+    }
+    for (int i = 0; i < material.count; i++)
+        position.squares[slots[i]] = squares[i];
+    return tb_index(material, position) == whole;
+}
+
+tablebase::tablebase(const char *path) : file(path)
+{
+    if (!file.is_open() || file.length() < header_size || memcmp(file.bytes(), magic, sizeof(magic)))
+        return;
+    const char *name = reinterpret_cast<const char *>(file.bytes() + sizeof(magic));
+    uint64_t entries;
+    memcpy(&entries, file.bytes() + sizeof(magic) + name_size, sizeof(entries));
+    if (!tb_material_t::parse({name, strnlen(name, name_size)}, mat))
+        return;
+    valid = entries == mat.size() && file.length() == header_size + entries;
+    values = file.bytes() + header_size;
+}
+
+std::string tablebase::header(const tb_material_t &material)
+{
+    std::string header(magic, sizeof(magic));
+    std::string name = material.name();
+    name.resize(name_size, '\0');
+    header += name;
+    uint64_t entries = material.size();
+    header.append(reinterpret_cast<const char *>(&entries), sizeof(entries));
+    return header;
+}
+
+bool tablebase_set::open(const std::string &directory, std::string_view name)
+{
+    tb_material_t material;
+    if (!tb_material_t::parse(name, material))
+        return false;
+    if (has(material))
+        return true;
+    tablebase table((directory + "/" + material.name() + ".tb").c_str());
+    if (!table.is_open() || table.material().name() != material.name())
+        return false;
+    const tablebase &opened = tables.emplace(material.name(), std::move(table)).first->second;
+    by_key[material.key()] = &opened;
+    by_key[material.key(true)] = &opened;
+    return true;
+}
+
+bool tablebase_set::probe(const tb_piece_t *pieces, int count, bool white_turn, uint8_t &value) const
+{
+    tb_material_t material;
+    tb_position_t position;
+    if (!tb_normalise(pieces, count, white_turn, material, position))
+        return false;
+    if (material.count == 2)
+    {
+        value = tb_draw;
+        return true;
+    }
+    auto found = tables.find(material.name());
+    if (found == tables.end())
+        return false;
+    value = found->second.probe(position);
+    return true;
+}
+
+size_t tablebase_set::open_directory(const std::string &directory)
+{
+    std::error_code error;
+    for (const auto &file : std::filesystem::directory_iterator(directory, error))
+        if (file.path().extension() == ".tb")
+            open(directory, file.path().stem().string());
+    syzygy.open_directory(directory);
+    return size();
+}
+
+namespace
+{
+    // whether the side to move can take the pawn that has just moved two squares
+    bool can_take_en_passant(const game_t &game)
+    {
+        coordinate_t pawn = game.enpassant;
+        if (pawn == coordinate_t{0, 0})
+            return false;
+        bool beside = false;
+        for (int dx : {-1, 1})
+        {
+            piece_t piece = game.get(uint8_t(pawn.x + dx), pawn.y);
+            beside |= piece.ispawn() && piece.iswhite() == game.white_turn;
+        }
+        if (!beside)
+            return false;
+        // the capture may leave the own king in check
+        coordinate_t target(pawn.x, game.white_turn ? pawn.y + 1 : pawn.y - 1);
+        for (move_t m : game.legal_moves())
+            if (m.to == target && m.from.y == pawn.y && game.get(m.from).ispawn())
+                return true;
+        return false;
+    }
+}
+
+bool tablebase_set::probe(const game_t &game, uint8_t &value) const
+{
+    // bare kings are a draw without a table
+    constexpr uint64_t kings = material_unit(true, piece_type::king) + material_unit(false, piece_type::king);
+    if (by_key.empty())
+        return false;
+    if (game.material == kings)
+    {
+        value = tb_draw;
+        return true;
+    }
+    auto found = by_key.find(game.material);
+    if (found == by_key.end() || game.castling_rights() || can_take_en_passant(game))
+        return false;
+    tb_piece_t pieces[tb_max_pieces];
+    int count = 0;
+    for (const auto &row : game.board)
+        for (const auto &piece : row)
+        {
+            if (piece.isinvalid())
+                continue;
+            coordinate_t p = piece.get_position();
+            pieces[count++] = {piece.get_type(), piece.iswhite(), uint8_t((p.y - 1) * 8 + p.x - 1)};
+        }
+    tb_material_t material;
+    tb_position_t position;
+    if (!tb_normalise(pieces, count, game.white_turn, material, position))
+        return false;
+    value = found->second->probe(position);
+    return true;
+}
@@ -0,0 +1,147 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "chess.hpp"
+#include "mapped_file.hpp"
+#include "syzygy.hpp"
+
+// Distance to mate tables for endings with a few pieces, written by
+// generate_tablebase. Squares are numbered 0 to 63, a1 = 0, b1 = 1, a2 = 8.
+// Castling and en passant are not part of a table's positions.
+
+constexpr int tb_max_pieces = 5;
+
+// A table stores one byte per position. tb_draw and tb_invalid aside, the
+// value is the distance to mate in plies plus one: odd distances are wins for
+// the side to move, even ones losses, 0 plies being checkmated.
+constexpr uint8_t tb_draw = 0;
+constexpr uint8_t tb_invalid = 255;
+constexpr int tb_max_plies = 253;
+inline bool tb_is_result(uint8_t value) { return value != tb_draw && value != tb_invalid; }
+inline int tb_plies(uint8_t value) { return value - 1; }
+inline bool tb_wins(uint8_t value) { return tb_is_result(value) && tb_plies(value) % 2 == 1; }
+inline bool tb_loses(uint8_t value) { return tb_is_result(value) && tb_plies(value) % 2 == 0; }
+inline uint8_t tb_value(int plies) { return uint8_t(plies + 1); }
+
+struct tb_piece_t
+{
+    piece_type type;
+    bool white;
+    uint8_t square;
+};
+
+// Pieces of an ending, the stronger side playing white. White's pieces come
+// first, then black's, each side's king first and the rest in the order
+// Q R B N P.
+struct tb_material_t
+{
+    piece_type types[tb_max_pieces];
+    bool white[tb_max_pieces];
+    int count = 0;
+
+    // "KRPvKR", the side before the v is white. Orders and swaps the sides as needed.
+    static bool parse(std::string_view name, tb_material_t &material);
+    std::string name() const;
+    // the game_t::material of the ending, or of its colours swapped
+    uint64_t key(bool swapped = false) const;
+    bool has_pawns() const;
+    // entries in the table
+    uint64_t size() const;
+};
+
+// Squares of the pieces, in the order of their material
+struct tb_position_t
+{
+    uint8_t squares[tb_max_pieces];
+    bool white_turn;
+};
+
+// Orders loose pieces as a table stores them, swapping colours (and mirroring
+// the ranks) when black is the stronger side. False without exactly one king
+// each or with too many pieces.
+bool tb_normalise(const tb_piece_t *pieces, int count, bool white_turn, tb_material_t &material,
+                  tb_position_t &position);
+// Index after reflecting the board so the white king lands on a1-d1-d4, or on
+// files a-d with pawns on the board. The kings are one index over the pairs
+// of squares on which they do not touch, pawns then count only ranks 2 to 7
+// and every piece only the squares the pieces before it left free.
+// tb_no_index when no table position matches, such as for touching kings.
+constexpr uint64_t tb_no_index = ~0ull;
+uint64_t tb_index(const tb_material_t &material, tb_position_t position);
+// False for the indices no position has, with pieces sharing a square or the
+// unused reflection of a position with both kings on the diagonal
+bool tb_decode(const tb_material_t &material, uint64_t index, tb_position_t &position);
+
+// A table file, memory mapped
+class tablebase
+{
+public:
+    tablebase() = default;
+    explicit tablebase(const char *path);
+
+    // false if the file is missing or not a whole table
+    bool is_open() const { return valid; }
+    const tb_material_t &material() const { return mat; }
+    uint8_t probe(const tb_position_t &position) const
+    {
+        uint64_t index = tb_index(mat, position);
+        return index == tb_no_index ? tb_invalid : values[index];
+    }
+    // header written before the values
+    static std::string header(const tb_material_t &material);
+
+private:
+    mapped_file file;
+    tb_material_t mat;
+    const uint8_t *values = nullptr;
+    bool valid = false;
+};
+
+// Tables by material name, with the Syzygy tables of the same directories
+class tablebase_set
+{
+public:
+    // opens directory/<name>.tb, true if it is there or was already open
+    bool open(const std::string &directory, std::string_view material);
+    // opens every table in the directory and every Syzygy ending,
+    // returns how many there are in all
+    size_t open_directory(const std::string &directory);
+    bool has(const tb_material_t &material) const { return tables.count(material.name()) != 0; }
+    // false if no open table covers the pieces. Bare kings are a draw.
+    bool probe(const tb_piece_t *pieces, int count, bool white_turn, uint8_t &value) const;
+    // also false with castling rights or a legal en passant capture, which
+    // tables leave out
+    bool probe(const game_t &game, uint8_t &value) const;
+    // see syzygy_tables
+    bool probe_wdl(const game_t &game, int &wdl) const { return syzygy.probe_wdl(game, wdl); }
+    bool probe_dtz(const game_t &game, int &dtz) const { return syzygy.probe_dtz(game, dtz); }
+    bool probe_root(const game_t &game, std::vector<move_t> &moves) const { return syzygy.probe_root(game, moves); }
+    size_t size() const { return tables.size() + syzygy.size(); }
+
+private:
+    std::map<std::string, tablebase, std::less<>> tables;
+    // the same tables by the key of either colouring, for probing from a game
+    std::unordered_map<uint64_t, const tablebase *> by_key;
+    syzygy_tables syzygy;
+};
+
+struct tb_generate_stats_t
+{
+    std::string name;
+    uint64_t entries = 0, wins = 0, losses = 0, draws = 0, invalid = 0;
+    // most plies to mate for the side to move that wins
+    int longest = 0;
+    int passes = 0;
+    double seconds = 0;
+    // the table was already on disk
+    bool existed = false;
+};
+
+// Writes directory/<name>.tb by retrograde analysis using `threads` threads,
+// generating or opening first every table a capture or a promotion leads to.
+// Finished tables are added to `tables`; on_table hears about each one.
+bool generate_tablebase(std::string_view material, const std::string &directory, unsigned threads,
+                        tablebase_set &tables, void (*on_table)(const tb_generate_stats_t &) = nullptr);
@@ -0,0 +1,490 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include "tablebase.hpp"
+
+namespace
+{
+    constexpr int king_steps[8][2] = {{1, 0}, {1, 1}, {0, 1}, {-1, 1}, {-1, 0}, {-1, -1}, {0, -1}, {1, -1}};
+    constexpr int knight_steps[8][2] = {{1, 2}, {2, 1}, {2, -1}, {1, -2}, {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2}};
+    // rook directions, then bishop ones
+    constexpr int rays[8][2] = {{1, 0}, {0, 1}, {-1, 0}, {0, -1}, {1, 1}, {-1, 1}, {-1, -1}, {1, -1}};
+    constexpr piece_type promotions[] = {piece_type::queen, piece_type::rook, piece_type::bishop, piece_type::knight};
+
+    bool on_board(int x, int y) { return x >= 0 && x < 8 && y >= 0 && y < 8; }
+    int sign(int v) { return (v > 0) - (v < 0); }
+
+    // a table position laid out on a board, squares hold the material slot on them
+    struct board_t
+    {
+        const tb_material_t *material;
+        tb_position_t position;
+        int8_t at[64];
+        int black_king;
+
+        // false if two pieces share a square or a pawn stands on the first or last rank
+        bool setup(const tb_material_t &m, const tb_position_t &p)
+        {
+            material = &m;
+            position = p;
+            std::fill(at, at + 64, int8_t(-1));
+            for (int slot = 0; slot < m.count; slot++)
+            {
+                uint8_t square = p.squares[slot];
+                if (at[square] >= 0 || (m.types[slot] == piece_type::pawn && (square < 8 || square >= 56)))
+                    return false;
+                at[square] = int8_t(slot);
+                if (m.types[slot] == piece_type::king && !m.white[slot])
+                    black_king = slot;
+            }
+            return true;
+        }
+
+        uint8_t king(bool white) const { return position.squares[white ? 0 : black_king]; }
+
+        bool attacks(int slot, int target) const
+        {
+            int from = position.squares[slot];
+            int dx = (target & 7) - (from & 7), dy = (target >> 3) - (from >> 3);
+            if (!dx && !dy)
+                return false;
+            switch (material->types[slot])
+            {
+            case piece_type::king:
+                return abs(dx) <= 1 && abs(dy) <= 1;
+            case piece_type::knight:
+                return abs(dx) * abs(dy) == 2;
+            case piece_type::pawn:
+                return abs(dx) == 1 && dy == (material->white[slot] ? 1 : -1);
+            case piece_type::rook:
+                if (dx && dy)
+                    return false;
+                break;
+            case piece_type::bishop:
+                if (abs(dx) != abs(dy))
+                    return false;
+                break;
+            case piece_type::queen:
+                if (dx && dy && abs(dx) != abs(dy))
+                    return false;
+                break;
+            default:
+                return false;
+            }
+            int step = sign(dy) * 8 + sign(dx);
+            for (int square = from + step; square != target; square += step)
+                if (at[square] >= 0)
+                    return false;
+            return true;
+        }
+
+        // `ignore` is a piece that has just been captured
+        bool attacked(int square, bool by_white, int ignore = -1) const
+        {
+            for (int slot = 0; slot < material->count; slot++)
+                if (slot != ignore && material->white[slot] == by_white && attacks(slot, square))
+                    return true;
+            return false;
+        }
+
+        // calls on_target(to) for the pseudo legal destinations of a piece,
+        // pawn captures included and pushes only onto empty squares
+        template <class F>
+        void targets(int slot, F &&on_target) const
+        {
+            int from = position.squares[slot], x = from & 7, y = from >> 3;
+            bool white = material->white[slot];
+            auto add = [&](int tx, int ty)
+            {
+                if (!on_board(tx, ty))
+                    return false;
+                int occupant = at[ty * 8 + tx];
+                if (occupant < 0 || material->white[occupant] != white)
+                    on_target(ty * 8 + tx);
+                return occupant < 0;
+            };
+            switch (material->types[slot])
+            {
+            case piece_type::king:
+                for (auto &s : king_steps)
+                    add(x + s[0], y + s[1]);
+                break;
+            case piece_type::knight:
+                for (auto &s : knight_steps)
+                    add(x + s[0], y + s[1]);
+                break;
+            case piece_type::pawn:
+            {
+                int dy = white ? 1 : -1;
+                if (at[from + dy * 8] < 0)
+                {
+                    on_target(from + dy * 8);
+                    if (y == (white ? 1 : 6) && at[from + dy * 16] < 0)
+                        on_target(from + dy * 16);
+                }
+                for (int dx : {-1, 1})
+                    if (on_board(x + dx, y + dy))
+                    {
+                        int occupant = at[from + dy * 8 + dx];
+                        if (occupant >= 0 && material->white[occupant] != white)
+                            on_target(from + dy * 8 + dx);
+                    }
+                break;
+            }
+            default:
+            {
+                piece_type type = material->types[slot];
+                int first = type == piece_type::bishop ? 4 : 0, last = type == piece_type::rook ? 4 : 8;
+                for (int r = first; r < last; r++)
+                    for (int tx = x + rays[r][0], ty = y + rays[r][1]; add(tx, ty); tx += rays[r][0], ty += rays[r][1])
+                        ;
+            }
+            }
+        }
+
+        // calls on_move(slot, to, captured slot or -1, promotion) for each legal move
+        template <class F>
+        void moves(F &&on_move) const
+        {
+            bool white = position.white_turn;
+            for (int slot = 0; slot < material->count; slot++)
+            {
+                if (material->white[slot] != white)
+                    continue;
+                targets(slot, [&](int to)
+                        {
+                    board_t after = *this;
+                    int captured = at[to];
+                    after.at[position.squares[slot]] = -1;
+                    after.at[to] = int8_t(slot);
+                    after.position.squares[slot] = uint8_t(to);
+                    if (after.attacked(after.king(white), !white, captured))
+                        return;
+                    if (material->types[slot] == piece_type::pawn && (to < 8 || to >= 56))
+                        for (piece_type promotion : promotions)
+                            on_move(slot, to, captured, promotion);
+                    else
+                        on_move(slot, to, captured, piece_type::invalid); });
+            }
+        }
+
+        // calls on_unmove(slot, from) for each way the side not to move could
+        // have reached this position without capturing or promoting
+        template <class F>
+        void unmoves(F &&on_unmove) const
+        {
+            bool white = !position.white_turn;
+            for (int slot = 0; slot < material->count; slot++)
+            {
+                if (material->white[slot] != white)
+                    continue;
+                int to = position.squares[slot], y = to >> 3;
+                if (material->types[slot] == piece_type::pawn)
+                {
+                    int dy = white ? -1 : 1;
+                    int from = to + dy * 8;
+                    if (y + dy >= 1 && y + dy <= 6 && at[from] < 0)
+                    {
+                        on_unmove(slot, from);
+                        if (y == (white ? 3 : 4) && at[from + dy * 8] < 0)
+                            on_unmove(slot, from + dy * 8);
+                    }
+                    continue;
+                }
+                // the other pieces move the same way backwards, onto empty squares only
+                targets(slot, [&](int from)
+                        {
+                    if (at[from] < 0)
+                        on_unmove(slot, from); });
+            }
+        }
+    };
+
+    // more than the moves or unmoves of any position with tb_max_pieces pieces
+    constexpr int max_moves = 128;
+
+    // adds index unless it is there already, returns whether it was added
+    bool add_distinct(uint64_t *indices, int &count, uint64_t index)
+    {
+        if (std::find(indices, indices + count, index) != indices + count)
+            return false;
+        indices[count++] = index;
+        return true;
+    }
+
+    struct exits_t
+    {
+        // plies to mate through the best capture or promotion, -1 if none wins
+        int win = -1;
+        // plies to mate through the slowest losing exit, -1 if none loses
+        int loss = -1;
+        bool draw = false;
+        // Positions in the table a move leads to, each index once. Moves to
+        // reflections of one position share an index, and the retrograde
+        // passes come back from it once.
+        uint64_t successors[max_moves];
+        int internal = 0;
+        int legal = 0;
+        bool missing = false;
+    };
+
+    // captures and promotions leave the table, their outcome comes from the smaller tables
+    exits_t examine(const board_t &board, const tablebase_set &tables)
+    {
+        exits_t exits;
+        const tb_material_t &material = *board.material;
+        board.moves([&](int slot, int to, int captured, piece_type promotion)
+                    {
+            exits.legal++;
+            if (captured < 0 && promotion == piece_type::invalid)
+            {
+                tb_position_t next = board.position;
+                next.squares[slot] = uint8_t(to);
+                next.white_turn = !next.white_turn;
+                add_distinct(exits.successors, exits.internal, tb_index(material, next));
+                return;
+            }
+            tb_piece_t pieces[tb_max_pieces];
+            int count = 0;
+            for (int i = 0; i < material.count; i++)
+            {
+                if (i == captured)
+                    continue;
+                tb_piece_t &piece = pieces[count++];
+                piece = {material.types[i], material.white[i], board.position.squares[i]};
+                if (i == slot)
+                {
+                    piece.square = uint8_t(to);
+                    if (promotion != piece_type::invalid)
+                        piece.type = promotion;
+                }
+            }
+            uint8_t value;
+            if (!tables.probe(pieces, count, !board.position.white_turn, value))
+                exits.missing = true;
+            else if (tb_loses(value))
+                exits.win = exits.win < 0 ? tb_plies(value) + 1 : std::min(exits.win, tb_plies(value) + 1);
+            else if (tb_wins(value))
+                exits.loss = std::max(exits.loss, tb_plies(value) + 1);
+            else
+                exits.draw = true; });
+        return exits;
+    }
+
+    // runs body(begin, end) over blocks of [0, size) on `threads` threads
+    template <class F>
+    void parallel_for(uint64_t size, unsigned threads, const F &body)
+    {
+        constexpr uint64_t block = 1 << 14;
+        std::atomic<uint64_t> next{0};
+        auto work = [&]
+        {
+            for (uint64_t begin; (begin = next.fetch_add(block)) < size;)
+                body(begin, std::min(size, begin + block));
+        };
+        std::vector<std::thread> pool;
+        for (unsigned i = 1; i < threads; i++)
+            pool.emplace_back(work);
+        work();
+        for (std::thread &thread : pool)
+            thread.join();
+    }
+
+    void raise(std::atomic<int> &value, int to)
+    {
+        int current = value;
+        while (current < to && !value.compare_exchange_weak(current, to))
+            ;
+    }
+
+    // materials one capture or promotion away
+    std::vector<tb_material_t> successors(const tb_material_t &material)
+    {
+        std::vector<tb_material_t> found;
+        for (int slot = 0; slot < material.count; slot++)
+        {
+            if (material.types[slot] == piece_type::king)
+                continue;
+            tb_piece_t pieces[tb_max_pieces];
+            auto add = [&](int skip, piece_type replacement)
+            {
+                int count = 0;
+                for (int i = 0; i < material.count; i++)
+                    if (i != skip)
+                        pieces[count++] = {i == slot && replacement != piece_type::invalid ? replacement : material.types[i],
+                                           material.white[i], 0};
+                tb_material_t next;
+                tb_position_t unused;
+                if (count > 2 && tb_normalise(pieces, count, true, next, unused))
+                    found.push_back(next);
+            };
+            add(slot, piece_type::invalid);
+            if (material.types[slot] == piece_type::pawn)
+                for (piece_type promotion : promotions)
+                    add(-1, promotion);
+        }
+        return found;
+    }
+}
+
+bool generate_tablebase(std::string_view name, const std::string &directory, unsigned threads,
+                        tablebase_set &tables, void (*on_table)(const tb_generate_stats_t &))
+{
+    tb_material_t material;
+    if (!tb_material_t::parse(name, material))
+        return false;
+    if (tables.has(material))
+        return true;
+    tb_generate_stats_t stats;
+    stats.name = material.name();
+    stats.entries = material.size();
+    if (tables.open(directory, stats.name))
+    {
+        stats.existed = true;
+        if (on_table)
+            on_table(stats);
+        return true;
+    }
+    for (const tb_material_t &next : successors(material))
+        if (!generate_tablebase(next.name(), directory, threads, tables, on_table))
+            return false;
+
+    auto start = std::chrono::steady_clock::now();
+    threads = std::max(threads, 1u);
+    uint64_t size = material.size();
+    // values as they will be written, and for undecided positions the moves
+    // not yet known to lose
+    std::unique_ptr<std::atomic<uint8_t>[]> values(new std::atomic<uint8_t>[size]);
+    std::unique_ptr<std::atomic<uint8_t>[]> pending(new std::atomic<uint8_t>[size]);
+    std::atomic<int> horizon{0};
+    std::atomic<bool> failed{false};
+
+    // mates, stalemates, illegal positions and everything decided by leaving the table
+    parallel_for(size, threads, [&](uint64_t begin, uint64_t end)
+                 {
+        board_t board;
+        tb_position_t position;
+        for (uint64_t index = begin; index < end; index++)
+        {
+            pending[index].store(0, std::memory_order_relaxed);
+            if (!tb_decode(material, index, position) || !board.setup(material, position) || board.attacked(board.king(!position.white_turn), position.white_turn))
+            {
+                values[index].store(tb_invalid, std::memory_order_relaxed);
+                continue;
+            }
+            exits_t exits = examine(board, tables);
+            uint8_t value = tb_draw;
+            if (exits.missing || exits.win > tb_max_plies || exits.loss > tb_max_plies)
+                failed = true;
+            else if (!exits.legal)
+                value = board.attacked(board.king(position.white_turn), !position.white_turn) ? tb_value(0) : tb_draw;
+            // a quicker mate inside the table may still replace this
+            else if (exits.win >= 0)
+                value = tb_value(exits.win);
+            else if (!exits.internal)
+                value = exits.draw ? tb_draw : tb_value(exits.loss);
+            else
+                // a drawing exit keeps one move that never turns out to lose
+                pending[index].store(uint8_t(exits.internal + exits.draw), std::memory_order_relaxed);
+            if (tb_is_result(value))
+                raise(horizon, tb_plies(value));
+            values[index].store(value, std::memory_order_relaxed);
+        } });
+    if (failed)
+        return false;
+
+    // Pass n takes the positions decided at n plies back one move. A loss
+    // makes every predecessor a win in n + 1, a win takes one move off each
+    // predecessor's count and the last one makes it a loss.
+    int passes = 0;
+    for (int n = 0; n <= horizon && !failed; n++, passes++)
+    {
+        if (n + 1 > tb_max_plies)
+        {
+            failed = true;
+            break;
+        }
+        parallel_for(size, threads, [&](uint64_t begin, uint64_t end)
+                     {
+            board_t board, before;
+            tb_position_t position;
+            uint64_t predecessors[max_moves];
+            for (uint64_t index = begin; index < end; index++)
+            {
+                if (values[index].load(std::memory_order_relaxed) != tb_value(n))
+                    continue;
+                tb_decode(material, index, position);
+                board.setup(material, position);
+                int count = 0;
+                board.unmoves([&](int slot, int from)
+                              {
+                    tb_position_t previous = position;
+                    previous.squares[slot] = uint8_t(from);
+                    previous.white_turn = !position.white_turn;
+                    uint64_t p = tb_index(material, previous);
+                    // a king stepping back next to the other one, or a
+                    // reflection of a predecessor already seen
+                    if (p == tb_no_index || !add_distinct(predecessors, count, p))
+                        return;
+                    uint8_t current = values[p].load(std::memory_order_relaxed);
+                    if (n % 2 == 0)
+                    {
+                        while ((current == tb_draw || (tb_wins(current) && tb_plies(current) > n + 1)) &&
+                               !values[p].compare_exchange_weak(current, tb_value(n + 1), std::memory_order_relaxed))
+                            ;
+                        raise(horizon, n + 1);
+                        return;
+                    }
+                    if (current != tb_draw || pending[p].fetch_sub(1, std::memory_order_relaxed) != 1)
+                        return;
+                    // every move loses, as slowly as the slowest exit allows
+                    before.setup(material, previous);
+                    int plies = std::max(n + 1, examine(before, tables).loss);
+                    values[p].store(tb_value(plies), std::memory_order_relaxed);
+                    raise(horizon, plies); });
+            } });
+    }
+    if (failed)
+        return false;
+
+    for (uint64_t index = 0; index < size; index++)
+    {
+        uint8_t value = values[index].load(std::memory_order_relaxed);
+        if (value == tb_invalid)
+            stats.invalid++;
+        else if (value == tb_draw)
+            stats.draws++;
+        else if (tb_wins(value))
+        {
+            stats.wins++;
+            stats.longest = std::max(stats.longest, tb_plies(value));
+        }
+        else
+            stats.losses++;
+    }
+    stats.passes = passes;
+
+    // written under a temporary name so a table that exists is always whole
+    std::string path = directory + "/" + stats.name + ".tb", temporary = path + ".tmp";
+    FILE *file = fopen(temporary.c_str(), "wb");
+    if (!file)
+        return false;
+    std::string header = tablebase::header(material);
+    bool ok = fwrite(header.data(), 1, header.size(), file) == header.size();
+    static_assert(sizeof(std::atomic<uint8_t>) == 1, "values are written as they are in memory");
+    ok = fwrite(values.get(), 1, size, file) == size && ok;
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(temporary.c_str(), path.c_str()) != 0 || !tables.open(directory, stats.name))
+    {
+        remove(temporary.c_str());
+        return false;
+    }
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (on_table)
+        on_table(stats);
+    return true;
+}
@@ -0,0 +1,108 @@
+// Checks the PGN reader: the moves for_each_san hands over from movetext
+// with comments, variations and broken punctuation, and SAN both ways.
+// Prints every failure and exits with 1 if there was one.
+//
+//   pgn-test
+#include <cstdio>
+#include <string>
+#include "pgn.hpp"
+
+namespace
+{
+    int failures = 0;
+
+    void fail(const char *what, const std::string &detail)
+    {
+        fprintf(stderr, "FAILED %s: %s\n", what, detail.c_str());
+        failures++;
+    }
+
+    void test_for_each_san()
+    {
+        struct
+        {
+            const char *movetext;
+            // the tokens joined by spaces, then the result
+            const char *moves;
+            const char *result;
+        } cases[] = {
+            {"1. e4 e5 2. Nf3 Nc6 1-0", "e4 e5 Nf3 Nc6", "1-0"},
+            {"1.e4 e5 2.Nf3 2...Nc6 *", "e4 e5 Nf3 Nc6", "*"},
+            {"1. e4 {best (by test)} e5 ; a comment\n2. Nf3 $1 Nc6 1/2-1/2", "e4 e5 Nf3 Nc6", "1/2-1/2"},
+            {"1. e4 (1. d4 d5 (1... Nf6 {a (nested) comment}) 2. c4) 1... e5 0-1", "e4 e5", "0-1"},
+            // a variation left open runs to the end
+            {"1. e4 e5 (2. Nf3", "e4 e5", ""},
+            // a stray closing parenthesis, as some broken exports have
+            {"1. e4 e5 ) 2. Nf3 *", "e4 e5 Nf3", "*"},
+            {")", "", ""},
+            {"1. e4 ))) e5", "e4 e5", ""},
+        };
+        for (const auto &c : cases)
+        {
+            std::string moves;
+            std::string_view result = for_each_san(c.movetext, [&](std::string_view san)
+                                                   {
+                moves += moves.empty() ? "" : " ";
+                moves += san;
+                return true; });
+            if (moves != c.moves || result != c.result)
+                fail("for_each_san", std::string(c.movetext) + " gave \"" + moves + "\" " + std::string(result));
+        }
+    }
+
+    void test_san()
+    {
+        struct
+        {
+            const char *fen;
+            const char *san;
+            // the move in coordinates with a promotion letter, empty if the SAN must not resolve
+            const char *move;
+        } cases[] = {
+            {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", "Nf3", "g1f3"},
+            {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", "e4", "e2e4"},
+            {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", "e5", ""},
+            {"4k3/8/8/8/8/5N2/8/1N2K3 w - - 0 1", "Nd2", ""},
+            {"4k3/8/8/8/8/5N2/8/1N2K3 w - - 0 1", "Nbd2", "b1d2"},
+            {"4k3/8/8/8/8/5N2/8/1N2K3 w - - 0 1", "Nfd2+", "f3d2"},
+            {"r3k2r/8/8/8/8/8/8/R3K2R w KQkq - 0 1", "O-O", "e1g1"},
+            {"r3k2r/8/8/8/8/8/8/R3K2R b KQkq - 0 1", "O-O-O", "e8c8"},
+            {"8/4P3/8/8/8/8/k7/4K3 w - - 0 1", "e8=N", "e7e8n"},
+            {"4k3/8/8/3pP3/8/8/8/4K3 w - d6 0 1", "exd6", "e5d6"},
+        };
+        for (const auto &c : cases)
+        {
+            game_t game;
+            if (!game_t::from_fen(c.fen, game))
+            {
+                fail("san setup", c.fen);
+                continue;
+            }
+            move_t move;
+            std::string found;
+            if (parse_san(game, c.san, move))
+            {
+                found = {char('a' + move.from.x - 1), char('0' + move.from.y), char('a' + move.to.x - 1), char('0' + move.to.y)};
+                if (move.promotion == piece_type::knight)
+                    found += 'n';
+                else if (move.promotion != piece_type::invalid)
+                    found += '?';
+            }
+            if (found != c.move)
+                fail("parse_san", std::string(c.fen) + " " + c.san + " gave \"" + found + "\"");
+            // written back it names the same move
+            move_t again;
+            if (!found.empty() && (!parse_san(game, to_san(game, move), again) || again != move))
+                fail("to_san", std::string(c.fen) + " " + c.san + " written as " + to_san(game, move));
+        }
+    }
+}
+
+int main()
+{
+    test_for_each_san();
+    test_san();
+    if (failures)
+        fprintf(stderr, "%d failed\n", failures);
+    return failures ? 1 : 0;
+}
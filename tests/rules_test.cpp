@@ -0,0 +1,170 @@
+// Checks the rules against published numbers: perft counts, FEN round trips
+// and rejects, and the Polyglot keys of the book format's own examples.
+// Prints every failure and exits with 1 if there was one.
+//
+//   rules-test
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include "book.hpp"
+#include "chess.hpp"
+
+namespace
+{
+    constexpr const char *start_fen = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+    int failures = 0;
+
+    void fail(const char *what, const char *detail)
+    {
+        fprintf(stderr, "FAILED %s: %s\n", what, detail);
+        failures++;
+    }
+
+    uint64_t perft(const game_t &game, int depth)
+    {
+        std::vector<move_t> moves = game.legal_moves();
+        if (depth == 1)
+            return moves.size();
+        uint64_t nodes = 0;
+        for (move_t m : moves)
+        {
+            game_t child = game;
+            child.play(m);
+            nodes += perft(child, depth - 1);
+        }
+        return nodes;
+    }
+
+    // "e2e4", promotions are not needed here
+    move_t coordinate_move(std::string_view text)
+    {
+        return {{uint8_t(text[0] - 'a' + 1), uint8_t(text[1] - '0')}, {uint8_t(text[2] - 'a' + 1), uint8_t(text[3] - '0')}};
+    }
+
+    // castling through and out of check, en passant, promotions and pins
+    void test_perft()
+    {
+        struct
+        {
+            const char *fen;
+            int depth;
+            uint64_t nodes;
+        } cases[] = {
+            {start_fen, 4, 197281},
+            {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 3, 97862},
+            {"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 4, 43238},
+            {"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 3, 9467},
+            {"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 3, 62379},
+            {"r3k2r/8/8/8/8/8/8/R3K2R w KQkq - 0 1", 3, 13744},
+        };
+        for (const auto &c : cases)
+        {
+            game_t game;
+            if (!game_t::from_fen(c.fen, game))
+            {
+                fail("perft setup", c.fen);
+                continue;
+            }
+            uint64_t nodes = perft(game, c.depth);
+            if (nodes != c.nodes)
+            {
+                std::string detail = std::string(c.fen) + " depth " + std::to_string(c.depth) + ": " +
+                                     std::to_string(nodes) + ", expected " + std::to_string(c.nodes);
+                fail("perft", detail.c_str());
+            }
+        }
+    }
+
+    void test_fen()
+    {
+        const char *round_trips[] = {
+            start_fen,
+            "rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1",
+            "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+            "r3k2r/8/8/8/8/8/8/R3K2R b Kq - 12 40",
+            "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+            "4k3/8/8/8/8/8/8/4K3 w - - 99 120",
+        };
+        for (const char *fen : round_trips)
+        {
+            game_t game;
+            if (!game_t::from_fen(fen, game))
+                fail("fen parse", fen);
+            else if (game.to_fen() != fen)
+                fail("fen round trip", (std::string(fen) + " came back as " + game.to_fen()).c_str());
+        }
+
+        const char *rejects[] = {
+            "",
+            "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR x KQkq - 0 1",
+            "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBN w KQkq - 0 1",
+            // no black king, two white kings
+            "8/8/8/8/8/8/8/K6K w - - 0 1",
+            // a pawn on the back rank
+            "P3k3/8/8/8/8/8/8/4K3 w - - 0 1",
+            // kings side by side
+            "8/8/8/3kK3/8/8/8/8 w - - 0 1",
+            // black to move could take the white king
+            "4k3/8/8/8/8/8/8/4K2r b - - 0 1",
+        };
+        for (const char *fen : rejects)
+        {
+            game_t game;
+            if (game_t::from_fen(fen, game))
+                fail("fen accepted", fen);
+        }
+    }
+
+    // the examples published with the Polyglot book format, each both from
+    // its FEN and from playing its moves from the start
+    void test_polyglot_keys()
+    {
+        struct
+        {
+            const char *fen;
+            const char *moves;
+            uint64_t key;
+        } cases[] = {
+            {start_fen, "", 0x463b96181691fc9cull},
+            {"rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1", "e2e4", 0x823c9b50fd114196ull},
+            {"rnbqkbnr/ppp1pppp/8/3p4/4P3/8/PPPP1PPP/RNBQKBNR w KQkq d6 0 2", "e2e4 d7d5", 0x0756b94461c50fb0ull},
+            {"rnbqkbnr/ppp1pppp/8/3pP3/8/8/PPPP1PPP/RNBQKBNR b KQkq - 0 2", "e2e4 d7d5 e4e5", 0x662fafb965db29d4ull},
+            {"rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3", "e2e4 d7d5 e4e5 f7f5",
+             0x22a48b5a8e47ff78ull},
+            {"rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPPKPPP/RNBQ1BNR b kq - 0 3", "e2e4 d7d5 e4e5 f7f5 e1e2",
+             0x652a607ca3f242c1ull},
+            {"rnbq1bnr/ppp1pkpp/8/3pPp2/8/8/PPPPKPPP/RNBQ1BNR w - - 0 4", "e2e4 d7d5 e4e5 f7f5 e1e2 e8f7",
+             0x00fdd303c946bdd9ull},
+            {"rnbqkbnr/p1pppppp/8/8/PpP4P/8/1P1PPPP1/RNBQKBNR b KQkq c3 0 3", "a2a4 b7b5 h2h4 b5b4 c2c4",
+             0x3c8123ea7b067637ull},
+            {"rnbqkbnr/p1pppppp/8/8/P6P/R1p5/1P1PPPP1/1NBQKBNR b Kkq - 0 4", "a2a4 b7b5 h2h4 b5b4 c2c4 b4c3 a1a3",
+             0x5c3f9b829b279560ull},
+        };
+        for (const auto &c : cases)
+        {
+            game_t from_fen, played;
+            if (!game_t::from_fen(c.fen, from_fen))
+            {
+                fail("polyglot setup", c.fen);
+                continue;
+            }
+            for (std::string_view moves = c.moves; moves.size() >= 4; moves.remove_prefix(std::min<size_t>(5, moves.size())))
+                played.play(coordinate_move(moves));
+            if (polyglot_key(from_fen) != c.key)
+                fail("polyglot key from fen", c.fen);
+            if (polyglot_key(played) != c.key)
+                fail("polyglot key after moves", c.moves);
+        }
+    }
+}
+
+int main()
+{
+    test_perft();
+    test_fen();
+    test_polyglot_keys();
+    if (failures)
+        fprintf(stderr, "%d failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,280 @@
+// Microbenchmarks of the rules over a fixed set of positions, printed as JSON
+// so runs from two commits can be diffed, and the search bench.
+//
+//   chess-bench [--filter name] [--min-time ms] [--samples N]
+//   chess-bench bench [depth] [--trace trace.json]
+//
+// Every benchmark repeats passes over the positions until a sample takes
+// --min-time / --samples (default 500 ms over 5 samples) and reports the
+// median ns per operation, heap allocations per operation counted through
+// operator new, and operations per second.
+//
+// bench searches the same positions to a fixed depth (5 by default) and
+// prints the total node count, a signature that changes with anything the
+// search does differently, and the nodes per second. In a build configured
+// with -DCHESS_TRACE=ON, --trace writes the search's trace events as Chrome
+// trace-event JSON for chrome://tracing or ui.perfetto.dev.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+#include "bench.hpp"
+#include "trace.hpp"
+
+namespace
+{
+    std::atomic<uint64_t> allocations{0};
+}
+
+void *operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+namespace
+{
+    int usage(const char *name)
+    {
+        fprintf(stderr, "usage: %s [--filter name] [--min-time ms] [--samples N]\n"
+                        "       %s bench [depth] [--trace trace.json]\n",
+                name, name);
+        return 1;
+    }
+
+    int bench(int depth, const char *trace_path)
+    {
+        bench_result_t result = run_bench(depth, 16, [](size_t index, const search_info_t &info)
+                                          { fprintf(stderr, "position %2zu/%zu  depth %d  score %6d  nodes %9llu\n",
+                                                    index + 1, bench_positions.size(), info.depth, info.score,
+                                                    (unsigned long long)info.nodes); });
+        printf("bench %llu nodes  %llu nps  %.2f s\n", (unsigned long long)result.nodes,
+               (unsigned long long)result.nps(), result.elapsed.count() / 1e6);
+        if (trace_path && !trace_write(trace_path))
+        {
+            fprintf(stderr, "could not write a trace to %s, build with -DCHESS_TRACE=ON\n", trace_path);
+            return 1;
+        }
+        return 0;
+    }
+
+    struct benchmark_t
+    {
+        const char *name;
+        // one pass over the positions, returns the operations done
+        std::function<uint64_t()> pass;
+    };
+
+    struct result_t
+    {
+        uint64_t ops = 0;
+        double ns_per_op = 0;
+        double allocations_per_op = 0;
+    };
+
+    // keeps the compiler from dropping work whose result is unused
+    volatile uint64_t sink;
+
+    result_t measure(const benchmark_t &benchmark, std::chrono::nanoseconds sample_time, int samples)
+    {
+        // warm up and count the allocations of one pass
+        uint64_t before = allocations.load();
+        uint64_t ops_per_pass = benchmark.pass();
+        result_t result;
+        result.allocations_per_op = double(allocations.load() - before) / std::max<uint64_t>(ops_per_pass, 1);
+
+        std::vector<double> times;
+        uint64_t passes = 1;
+        while ((int)times.size() < samples)
+        {
+            auto start = std::chrono::steady_clock::now();
+            uint64_t ops = 0;
+            for (uint64_t i = 0; i < passes; i++)
+                ops += benchmark.pass();
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            // grow the sample until it is long enough to time, then keep it
+            if (elapsed < sample_time && times.empty())
+            {
+                passes *= 2;
+                continue;
+            }
+            times.push_back(std::chrono::duration<double, std::nano>(elapsed).count() / ops);
+            result.ops += ops;
+        }
+        std::sort(times.begin(), times.end());
+        result.ns_per_op = times[times.size() / 2];
+        return result;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "bench") == 0)
+    {
+        int depth = bench_depth;
+        const char *trace_path = nullptr;
+        for (int i = 2; i < argc; i++)
+            if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+                trace_path = argv[++i];
+            else if (i == 2)
+                depth = std::min(std::max(atoi(argv[i]), 1), max_ply - 1);
+            else
+                return usage(argv[0]);
+        return bench(depth, trace_path);
+    }
+
+    std::string filter;
+    int min_time = 500, samples = 5;
+    for (int i = 1; i < argc; i += 2)
+        if (i + 1 == argc)
+            return usage(argv[0]);
+        else if (strcmp(argv[i], "--filter") == 0)
+            filter = argv[i + 1];
+        else if (strcmp(argv[i], "--min-time") == 0)
+            min_time = std::max(1, atoi(argv[i + 1]));
+        else if (strcmp(argv[i], "--samples") == 0)
+            samples = std::max(1, atoi(argv[i + 1]));
+        else
+            return usage(argv[0]);
+
+    std::vector<game_t> positions;
+    for (const char *fen : bench_positions)
+    {
+        game_t game;
+        if (!game_t::from_fen(fen, game))
+        {
+            fprintf(stderr, "bad corpus position %s\n", fen);
+            return 1;
+        }
+        positions.push_back(game);
+    }
+    // the pieces and moves the benchmarks go over, found once up front
+    std::vector<std::vector<piece_t>> movers;
+    std::vector<std::vector<move_t>> moves;
+    for (const game_t &game : positions)
+    {
+        movers.push_back(game.white_turn ? game.get_white_pieces() : game.get_black_pieces());
+        moves.push_back(game.legal_moves());
+    }
+
+    const std::vector<benchmark_t> benchmarks = {
+        {"available_moves", [&]
+         {
+             uint64_t ops = 0, found = 0;
+             for (size_t i = 0; i < positions.size(); i++)
+             {
+                 game_t &game = positions[i];
+                 for (const piece_t &piece : movers[i])
+                 {
+                     game.set_current_piece(piece);
+                     found += piece.available_moves(game, game.white_turn, game.enpassant).size();
+                     ops++;
+                 }
+             }
+             sink = found;
+             return ops;
+         }},
+        {"pseudo_moves", [&]
+         {
+             uint64_t ops = 0, found = 0;
+             for (size_t i = 0; i < positions.size(); i++)
+                 for (const piece_t &piece : movers[i])
+                 {
+                     found += piece.pseudo_moves(positions[i], positions[i].white_turn, positions[i].enpassant).size();
+                     ops++;
+                 }
+             sink = found;
+             return ops;
+         }},
+        {"legal_moves", [&]
+         {
+             uint64_t found = 0;
+             for (const game_t &game : positions)
+                 found += game.legal_moves().size();
+             sink = found;
+             return uint64_t(positions.size());
+         }},
+        {"in_check", [&]
+         {
+             uint64_t checks = 0;
+             for (const game_t &game : positions)
+                 checks += game.in_check(true) + game.in_check(false);
+             sink = checks;
+             return uint64_t(2 * positions.size());
+         }},
+        {"in_check_mate", [&]
+         {
+             uint64_t mates = 0;
+             for (const game_t &game : positions)
+                 mates += game.in_check_mate(game.white_turn);
+             sink = mates;
+             return uint64_t(positions.size());
+         }},
+        {"move", [&]
+         {
+             // includes copying the position, as every caller does
+             uint64_t ops = 0, turns = 0;
+             for (size_t i = 0; i < positions.size(); i++)
+                 for (move_t m : moves[i])
+                 {
+                     game_t game = positions[i];
+                     game.set_current_piece(game.get(m.from));
+                     game.move(m.to.x, m.to.y);
+                     turns += game.white_turn;
+                     ops++;
+                 }
+             sink = turns;
+             return ops;
+         }},
+        {"play", [&]
+         {
+             uint64_t ops = 0, turns = 0;
+             for (size_t i = 0; i < positions.size(); i++)
+                 for (move_t m : moves[i])
+                 {
+                     game_t game = positions[i];
+                     game.play(m);
+                     turns += game.white_turn;
+                     ops++;
+                 }
+             sink = turns;
+             return ops;
+         }},
+        {"hash", [&]
+         {
+             uint64_t key = 0;
+             for (const game_t &game : positions)
+                 key ^= game.hash();
+             sink = key;
+             return uint64_t(positions.size());
+         }},
+    };
+
+    auto sample_time = std::chrono::milliseconds(min_time) / samples;
+    printf("{\n  \"positions\": %zu,\n  \"samples\": %d,\n  \"benchmarks\": [", positions.size(), samples);
+    bool first = true;
+    for (const benchmark_t &benchmark : benchmarks)
+    {
+        if (!filter.empty() && std::string(benchmark.name).find(filter) == std::string::npos)
+            continue;
+        result_t result = measure(benchmark, sample_time, samples);
+        printf("%s\n    {\"name\": \"%s\", \"ops\": %llu, \"ns_per_op\": %.2f, \"allocations_per_op\": %.3f, \"ops_per_second\": %.0f}",
+               first ? "" : ",", benchmark.name, (unsigned long long)result.ops, result.ns_per_op,
+               result.allocations_per_op, 1e9 / result.ns_per_op);
+        fflush(stdout);
+        first = false;
+    }
+    printf("\n  ]\n}\n");
+    return 0;
+}
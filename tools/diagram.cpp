@@ -0,0 +1,147 @@
+// Draws a PNG board diagram for every position of an EPD or FEN file, on the
+// CPU and without OpenGL, so it runs on headless servers.
+//
+//   diagram positions.epd out_dir [--size px] [--threads N]
+//
+// Each diagram is --size pixels a side (800 by default, rounded down to a
+// multiple of 8) and is written to out_dir as its id operation, or as its
+// line number when it has none, with .png appended. Positions are shared out
+// to --threads workers, one per core by default.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "assets.hpp"
+#include "diagram.hpp"
+#include "mapped_file.hpp"
+
+namespace
+{
+    int usage(const char *name)
+    {
+        fprintf(stderr, "usage: %s positions.epd out_dir [--size px] [--threads N]\n", name);
+        return 1;
+    }
+
+    struct job_t
+    {
+        std::string name;
+        game_t game;
+    };
+
+    // the embedded piece images
+    std::array<std::array<image_t, 2>, 7> piece_sprites()
+    {
+        std::array<std::array<image_t, 2>, 7> sprites;
+        for (int type = 1; type < 7; type++)
+            for (bool white : {false, true})
+            {
+                const embedded_image_t *embedded = piece_image(piece_type(type), white);
+                if (!embedded)
+                    continue;
+                image_view_t view = pixels(*embedded);
+                if (!view.pixels)
+                    continue;
+                image_t &sprite = sprites[type][white];
+                sprite.width = view.width;
+                sprite.height = view.height;
+                sprite.pixels.assign(view.pixels, view.pixels + size_t(view.width) * view.height * 4);
+            }
+        return sprites;
+    }
+
+    // the id operation's value without quotes, empty if there is none
+    std::string find_id(std::string_view operations)
+    {
+        size_t at = operations.find("id ");
+        if (at == std::string_view::npos || (at && operations[at - 1] != ' ' && operations[at - 1] != ';'))
+            return {};
+        std::string_view value = operations.substr(at + 3);
+        value = value.substr(0, value.find(';'));
+        size_t first = value.find('"'), last = value.rfind('"');
+        if (first < last)
+            value = value.substr(first + 1, last - first - 1);
+        std::string id(value);
+        // keeps the name a plain file name
+        for (char &c : id)
+            if (c == '/' || c == '\\' || c == ' ')
+                c = '_';
+        return id;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3 || argc % 2 == 0)
+        return usage(argv[0]);
+    int size = 800;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 3; i + 1 < argc; i += 2)
+        if (strcmp(argv[i], "--size") == 0)
+            size = std::max(8, atoi(argv[i + 1]));
+        else if (strcmp(argv[i], "--threads") == 0)
+            threads = std::max(1, atoi(argv[i + 1]));
+        else
+            return usage(argv[0]);
+
+    mapped_file file(argv[1], true);
+    if (!file.is_open())
+    {
+        fprintf(stderr, "could not open %s\n", argv[1]);
+        return 1;
+    }
+    std::vector<job_t> jobs;
+    std::string_view text = file.text();
+    for (size_t line_number = 1; !text.empty(); line_number++)
+    {
+        size_t end = text.find('\n');
+        std::string_view line = text.substr(0, end);
+        text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+        if (line.find_first_not_of(" \t\r") == std::string_view::npos)
+            continue;
+        job_t job;
+        std::string_view operations;
+        if (!game_t::from_fen(line, job.game, &operations))
+        {
+            fprintf(stderr, "line %zu skipped: %.*s\n", line_number, int(line.size()), line.data());
+            continue;
+        }
+        job.name = find_id(operations);
+        if (job.name.empty())
+            job.name = std::to_string(line_number);
+        jobs.push_back(std::move(job));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    const diagram_renderer renderer(size / 8, piece_sprites());
+    std::atomic<size_t> next{0};
+    std::atomic<uint64_t> failed{0};
+    auto worker = [&]
+    {
+        image_t image;
+        for (size_t i; (i = next++) < jobs.size();)
+        {
+            renderer.render(jobs[i].game, image);
+            std::string path = std::string(argv[2]) + "/" + jobs[i].name + ".png";
+            if (!write_png(path.c_str(), image))
+            {
+                fprintf(stderr, "could not write %s\n", path.c_str());
+                failed++;
+            }
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned i = 0; i < std::min<size_t>(threads, std::max<size_t>(jobs.size(), 1)); i++)
+        pool.emplace_back(worker);
+    for (std::thread &t : pool)
+        t.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%zu diagrams of %d px  %.2f s  %.0f diagrams/s\n", jobs.size() - size_t(failed), renderer.size(), seconds,
+           jobs.size() / seconds);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,94 @@
+// Build step that compiles images into the program: writes a source file
+// defining embedded_images (see assets.hpp) as constexpr byte arrays, so
+// nothing is copied or constructed at startup.
+//
+//   embed-assets [--decode] images.cpp image.png...
+//
+// --decode stores each image as RGBA pixels, which costs about ten times
+// the space of the PNG but nothing to decode at run time.
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stb_image.hpp>
+
+namespace
+{
+    bool read_file(const char *path, std::vector<unsigned char> &data)
+    {
+        FILE *file = fopen(path, "rb");
+        if (!file)
+            return false;
+        fseek(file, 0, SEEK_END);
+        data.resize(size_t(ftell(file)));
+        fseek(file, 0, SEEK_SET);
+        bool read = fread(data.data(), 1, data.size(), file) == data.size();
+        fclose(file);
+        return read;
+    }
+
+    // "dir/white-pawn.png" is named white-pawn
+    std::string image_name(const char *path)
+    {
+        std::string name = path;
+        size_t slash = name.find_last_of("/\\");
+        if (slash != std::string::npos)
+            name.erase(0, slash + 1);
+        return name.substr(0, name.find('.'));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bool decode = argc > 1 && strcmp(argv[1], "--decode") == 0;
+    int first = 1 + decode;
+    if (argc < first + 1)
+    {
+        fprintf(stderr, "usage: %s [--decode] images.cpp image.png...\n", argv[0]);
+        return 1;
+    }
+    std::string out = "// generated by embed-assets, do not edit\n#include \"assets.hpp\"\n\nnamespace\n{\n";
+    std::string table;
+    for (int i = first + 1; i < argc; i++)
+    {
+        std::vector<unsigned char> data;
+        if (!read_file(argv[i], data))
+        {
+            fprintf(stderr, "could not read %s\n", argv[i]);
+            return 1;
+        }
+        int width = 0, height = 0;
+        if (decode)
+        {
+            auto pixels = stbi_load_from_memory(data.data(), int(data.size()), &width, &height, nullptr, 4);
+            if (!pixels)
+            {
+                fprintf(stderr, "could not decode %s\n", argv[i]);
+                return 1;
+            }
+            data.assign(pixels, pixels + size_t(width) * height * 4);
+            stbi_image_free(pixels);
+        }
+        std::string name = image_name(argv[i]), identifier = "image_" + std::to_string(i - first - 1);
+        out += "    constexpr unsigned char " + identifier + "[] = {";
+        char byte[16];
+        for (size_t j = 0; j < data.size(); j++)
+        {
+            snprintf(byte, sizeof(byte), "%s0x%02x,", j % 16 ? " " : "\n        ", data[j]);
+            out += byte;
+        }
+        out += "\n    };\n";
+        table += "    {\"" + name + "\", " + std::to_string(width) + ", " + std::to_string(height) + ", " + identifier +
+                 ", sizeof(" + identifier + ")},\n";
+    }
+    out += "}\n\nextern const embedded_image_t embedded_images[] = {\n" + table + "};\n";
+    out += "extern const size_t embedded_image_count = " + std::to_string(argc - first - 1) + ";\n";
+
+    FILE *file = fopen(argv[first], "wb");
+    if (!file || fwrite(out.data(), 1, out.size(), file) != out.size() || fclose(file) != 0)
+    {
+        fprintf(stderr, "could not write %s\n", argv[first]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,234 @@
+// Runs a test suite of EPD positions with best move (bm) or avoid move (am)
+// operations and reports how many the search solves and how fast.
+//
+//   epd-suite suite.epd [--time ms] [--nodes N] [--depth N] [--threads N] [--hash MB]
+//
+// Each position is searched on its own by one of --threads workers (one per
+// core by default) with the budget given, 1000 ms when none is. A position
+// is solved when the final best move is one of bm and none of am; its solve
+// time is the elapsed time of the iteration from which the best move stayed
+// right to the end. Moves may be SAN or coordinates like e7e8q.
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "mapped_file.hpp"
+#include "pgn.hpp"
+#include "search.hpp"
+
+namespace
+{
+    int usage(const char *name)
+    {
+        fprintf(stderr, "usage: %s suite.epd [--time ms] [--nodes N] [--depth N] [--threads N] [--hash MB]\n", name);
+        return 1;
+    }
+
+    struct test_t
+    {
+        std::string id;
+        game_t game;
+        std::vector<move_t> best, avoid;
+    };
+
+    struct outcome_t
+    {
+        bool solved = false;
+        // from the start of the search, -1 when not solved
+        double solve_ms = -1;
+        std::string move;
+        uint64_t nodes = 0;
+        double ms = 0;
+        int depth = 0;
+    };
+
+    // SAN, or coordinates as in e2e4 and e7e8q
+    bool parse_move(const game_t &game, std::string_view text, move_t &move)
+    {
+        if (parse_san(game, text, move))
+            return true;
+        if (text.size() < 4 || text.size() > 5)
+            return false;
+        for (move_t m : game.legal_moves())
+        {
+            char coordinates[6] = {char('a' + m.from.x - 1), char('0' + m.from.y), char('a' + m.to.x - 1),
+                                   char('0' + m.to.y), 0, 0};
+            if (m.promotion != piece_type::invalid)
+                coordinates[4] = "?prkbqn"[int(m.promotion)];
+            if (text == std::string_view(coordinates))
+            {
+                move = m;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // fills in bm, am and id from the operations, false if a move does not parse
+    bool parse_operations(std::string_view operations, test_t &test)
+    {
+        while (!operations.empty())
+        {
+            size_t end = operations.find(';');
+            std::string_view operation = operations.substr(0, end);
+            operations.remove_prefix(end == std::string_view::npos ? operations.size() : end + 1);
+            while (!operation.empty() && operation.front() == ' ')
+                operation.remove_prefix(1);
+            size_t space = operation.find(' ');
+            if (space == std::string_view::npos)
+                continue;
+            std::string_view opcode = operation.substr(0, space), operands = operation.substr(space + 1);
+            if (opcode == "id")
+            {
+                size_t first = operands.find('"'), last = operands.rfind('"');
+                test.id = first < last ? operands.substr(first + 1, last - first - 1) : operands;
+                continue;
+            }
+            if (opcode != "bm" && opcode != "am")
+                continue;
+            std::vector<move_t> &moves = opcode == "bm" ? test.best : test.avoid;
+            while (!operands.empty())
+            {
+                size_t next = operands.find(' ');
+                std::string_view word = operands.substr(0, next);
+                operands.remove_prefix(next == std::string_view::npos ? operands.size() : next + 1);
+                move_t move;
+                if (word.empty())
+                    continue;
+                if (!parse_move(test.game, word, move))
+                    return false;
+                moves.push_back(move);
+            }
+        }
+        return true;
+    }
+
+    bool right(const test_t &test, move_t move)
+    {
+        if (std::find(test.avoid.begin(), test.avoid.end(), move) != test.avoid.end())
+            return false;
+        return test.best.empty() || std::find(test.best.begin(), test.best.end(), move) != test.best.end();
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+        return usage(argv[0]);
+    search_limits_t limits;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t hash = 16;
+    for (int i = 2; i + 1 < argc; i += 2)
+    {
+        const char *value = argv[i + 1];
+        if (strcmp(argv[i], "--time") == 0)
+            limits.time = std::chrono::milliseconds(atoi(value));
+        else if (strcmp(argv[i], "--nodes") == 0)
+            limits.nodes = strtoull(value, nullptr, 10);
+        else if (strcmp(argv[i], "--depth") == 0)
+            limits.depth = std::min(atoi(value), max_ply - 1);
+        else if (strcmp(argv[i], "--threads") == 0)
+            threads = std::max(1, atoi(value));
+        else if (strcmp(argv[i], "--hash") == 0)
+            hash = size_t(atoi(value));
+        else
+            return usage(argv[0]);
+    }
+    if (argc % 2)
+        return usage(argv[0]);
+    if (!limits.time.count() && !limits.nodes && limits.depth == max_ply - 1)
+        limits.time = std::chrono::milliseconds(1000);
+
+    mapped_file file(argv[1], true);
+    if (!file.is_open())
+    {
+        fprintf(stderr, "could not open %s\n", argv[1]);
+        return 1;
+    }
+    std::vector<test_t> tests;
+    std::string_view text = file.text();
+    for (size_t line_number = 1; !text.empty(); line_number++)
+    {
+        size_t end = text.find('\n');
+        std::string_view line = text.substr(0, end);
+        text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+        if (line.find_first_not_of(" \t\r") == std::string_view::npos)
+            continue;
+        test_t test;
+        std::string_view operations;
+        if (!game_t::from_fen(line, test.game, &operations) || !parse_operations(operations, test) ||
+            (test.best.empty() && test.avoid.empty()))
+        {
+            fprintf(stderr, "line %zu skipped: %.*s\n", line_number, int(line.size()), line.data());
+            continue;
+        }
+        if (test.id.empty())
+            test.id = "line " + std::to_string(line_number);
+        tests.push_back(std::move(test));
+    }
+
+    std::vector<outcome_t> outcomes(tests.size());
+    std::atomic<size_t> next{0};
+    std::mutex mutex;
+    auto worker = [&]
+    {
+        transposition_table tt(hash);
+        searcher_t searcher(tt);
+        for (size_t i; (i = next++) < tests.size();)
+        {
+            const test_t &test = tests[i];
+            outcome_t &outcome = outcomes[i];
+            tt.clear();
+            double since = -1;
+            search_info_t info = searcher.search(test.game, limits, [&](const search_info_t &iteration)
+                                                 {
+                bool ok = right(test, iteration.pv.front());
+                if (ok && since < 0)
+                    since = iteration.elapsed.count() / 1000.0;
+                else if (!ok)
+                    since = -1; });
+            move_t move = info.pv.empty() ? move_t() : info.pv.front();
+            outcome.solved = !move.isnull() && right(test, move);
+            outcome.solve_ms = outcome.solved ? std::max(since, 0.0) : -1;
+            outcome.move = move.isnull() ? "none" : to_san(test.game, move);
+            outcome.nodes = info.nodes;
+            outcome.ms = info.elapsed.count() / 1000.0;
+            outcome.depth = info.depth;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (outcome.solved)
+                printf("%-20s  solved  %-8s  %8.1f ms  depth %2d\n", test.id.c_str(), outcome.move.c_str(),
+                       outcome.solve_ms, outcome.depth);
+            else
+                printf("%-20s  FAILED  %-8s  depth %2d\n", test.id.c_str(), outcome.move.c_str(), outcome.depth);
+            fflush(stdout);
+        }
+    };
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (unsigned i = 0; i < std::min<size_t>(threads, std::max<size_t>(tests.size(), 1)); i++)
+        pool.emplace_back(worker);
+    for (std::thread &t : pool)
+        t.join();
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t solved = 0;
+    uint64_t nodes = 0;
+    double search_ms = 0, solve_ms = 0;
+    for (const outcome_t &outcome : outcomes)
+    {
+        solved += outcome.solved;
+        nodes += outcome.nodes;
+        search_ms += outcome.ms;
+        if (outcome.solved)
+            solve_ms += outcome.solve_ms;
+    }
+    printf("solved %zu of %zu (%.1f%%)  mean solve time %.1f ms  nodes %llu  %.0f nps a thread  %.0f nps total  %.2f s\n",
+           solved, tests.size(), tests.empty() ? 0.0 : 100.0 * solved / tests.size(), solved ? solve_ms / solved : 0.0,
+           (unsigned long long)nodes, search_ms ? nodes / search_ms * 1000 : 0.0, wall ? nodes / wall : 0.0, wall);
+    return 0;
+}
@@ -0,0 +1,121 @@
+// Parses every line of an EPD or FEN file with game_t::from_fen, then writes
+// each position back with to_fen, and reports the throughput of both.
+//
+//   fen-bench positions.epd [passes]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string_view>
+#include <vector>
+#include "chess.hpp"
+
+static std::vector<char> read_file(const char *path)
+{
+    std::vector<char> data;
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return data;
+    fseek(f, 0, SEEK_END);
+    data.resize(ftell(f));
+    fseek(f, 0, SEEK_SET);
+    if (fread(data.data(), 1, data.size(), f) != data.size())
+        data.clear();
+    fclose(f);
+    return data;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s positions.epd [passes]\n", argv[0]);
+        return 1;
+    }
+    int passes = argc > 2 ? std::max(1, atoi(argv[2])) : 1;
+    std::vector<char> data = read_file(argv[1]);
+    if (data.empty())
+    {
+        fprintf(stderr, "could not read %s\n", argv[1]);
+        return 1;
+    }
+
+    std::vector<std::string_view> lines;
+    std::string_view text(data.data(), data.size());
+    for (size_t start = 0; start < text.size();)
+    {
+        size_t end = text.find('\n', start);
+        if (end == std::string_view::npos)
+            end = text.size();
+        std::string_view line = text.substr(start, end - start);
+        if (!line.empty() && line.back() == '\r')
+            line.remove_suffix(1);
+        if (!line.empty())
+            lines.push_back(line);
+        start = end + 1;
+    }
+
+    game_t game;
+    std::string_view operations;
+    size_t parsed = 0, rejected = 0, fen_bytes = 0;
+    uint64_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; pass++)
+        for (std::string_view line : lines)
+        {
+            if (game_t::from_fen(line, game, &operations))
+            {
+                parsed++;
+                checksum += game.white_king.x + game.black_king.y + game.white_turn;
+            }
+            else
+            {
+                rejected++;
+                if (pass == 0 && rejected <= 10)
+                    fprintf(stderr, "rejected: %.*s\n", int(line.size()), line.data());
+            }
+        }
+    double parse_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // serialising needs positions to write, they are parsed a batch at a time
+    // outside the timed part to keep memory bounded
+    std::vector<game_t> batch(4096);
+    size_t written = 0, mismatches = 0;
+    double write_seconds = 0;
+    char fen[128];
+    for (size_t first = 0; first < lines.size(); first += batch.size())
+    {
+        size_t count = 0;
+        for (size_t i = first; i < std::min(lines.size(), first + batch.size()); i++)
+            if (game_t::from_fen(lines[i], batch[count], &operations))
+                count++;
+
+        start = std::chrono::steady_clock::now();
+        for (int pass = 0; pass < passes; pass++)
+            for (size_t i = 0; i < count; i++)
+            {
+                fen_bytes += batch[i].to_fen(fen, sizeof(fen));
+                checksum += fen[0];
+            }
+        write_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        written += count * passes;
+
+        // what comes back must parse to the same position
+        for (size_t i = 0; i < count; i++)
+        {
+            batch[i].to_fen(fen, sizeof(fen));
+            if (!game_t::from_fen(fen, game) || game.hash() != batch[i].hash() || game.to_fen() != fen)
+                mismatches++;
+        }
+    }
+
+    size_t attempts = lines.size() * passes;
+    printf("lines       %zu x %d passes\n", lines.size(), passes);
+    printf("parsed      %zu (%zu rejected)\n", parsed, rejected);
+    printf("from_fen    %.3f s  %.2f M positions/s  %.1f MB/s\n", parse_seconds,
+           attempts / parse_seconds / 1e6, data.size() * double(passes) / parse_seconds / 1e6);
+    printf("to_fen      %.3f s  %.2f M positions/s  %.1f MB/s\n", write_seconds,
+           written / write_seconds / 1e6, fen_bytes / write_seconds / 1e6);
+    printf("round trip  %zu mismatches\n", mismatches);
+    printf("checksum    %llu\n", (unsigned long long)checksum);
+    return mismatches ? 1 : 0;
+}
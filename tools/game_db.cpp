@@ -0,0 +1,134 @@
+// Builds a position-indexed game database from PGN and finds the games that
+// reached a position.
+//
+//   game-db build games.pgn games.db [--memory MB] [--threads N]
+//   game-db query games.db [fen] [--limit N]
+//
+// build replays every game on all threads, stores it compressed and indexes
+// every position it reached, sorting externally within --memory (default
+// 256 MB). query looks the position up (the start position by default) and
+// lists the first --limit games (default 20) with the move each played there.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "game_db.hpp"
+#include "pgn.hpp"
+
+namespace
+{
+    int usage(const char *name)
+    {
+        fprintf(stderr, "usage: %s build games.pgn games.db [--memory MB] [--threads N]\n"
+                        "       %s query games.db [fen] [--limit N]\n",
+                name, name);
+        return 1;
+    }
+
+    int build(int argc, char **argv)
+    {
+        if (argc < 4)
+            return usage(argv[0]);
+        size_t megabytes = 256;
+        pgn_import_options_t options;
+        for (int i = 4; i + 1 < argc; i += 2)
+            if (strcmp(argv[i], "--memory") == 0)
+                megabytes = size_t(atoi(argv[i + 1]));
+            else if (strcmp(argv[i], "--threads") == 0)
+                options.threads = unsigned(atoi(argv[i + 1]));
+            else
+                return usage(argv[0]);
+
+        mapped_file pgn(argv[2], true);
+        if (!pgn.is_open())
+        {
+            fprintf(stderr, "could not open %s\n", argv[2]);
+            return 1;
+        }
+        auto start = std::chrono::steady_clock::now();
+        game_database_builder builder(argv[3], megabytes << 20);
+        uint64_t incomplete = 0;
+        import_pgn(pgn.text(), [&](const pgn_record_t &record)
+                   {
+            incomplete += !record.replayed;
+            return builder.add(record); },
+                   options);
+        if (!builder.finish())
+        {
+            fprintf(stderr, "could not write %s\n", argv[3]);
+            return 1;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        mapped_file out(argv[3]);
+        printf("%llu games (%llu cut short)  %llu positions  %zu runs  %.1f MB  %.2f s  %.0f games/s\n",
+               (unsigned long long)builder.games(), (unsigned long long)incomplete,
+               (unsigned long long)builder.positions(), builder.runs(), out.length() / 1e6, seconds,
+               builder.games() / seconds);
+        return 0;
+    }
+
+    int query(int argc, char **argv)
+    {
+        if (argc < 3)
+            return usage(argv[0]);
+        game_t position;
+        size_t limit = 20;
+        for (int i = 3; i < argc; i++)
+            if (strcmp(argv[i], "--limit") == 0 && i + 1 < argc)
+                limit = size_t(atoi(argv[++i]));
+            else if (!game_t::from_fen(argv[i], position))
+            {
+                fprintf(stderr, "bad fen %s\n", argv[i]);
+                return 1;
+            }
+
+        game_database database(argv[2]);
+        if (!database.is_open())
+        {
+            fprintf(stderr, "could not open %s\n", argv[2]);
+            return 1;
+        }
+        uint64_t key = position.hash();
+        std::vector<uint32_t> ids;
+        auto start = std::chrono::steady_clock::now();
+        size_t found = database.find(key, ids);
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        printf("%zu of %llu games in %.1f us\n", found, (unsigned long long)database.games(), us);
+
+        db_game_t game;
+        for (size_t i = 0; i < std::min(found, limit); i++)
+        {
+            if (!database.game(ids[i], game))
+            {
+                printf("%8u  unreadable\n", ids[i]);
+                continue;
+            }
+            // the move played from the position, if the game went on
+            std::string next = "end";
+            game_t g = game.start;
+            for (move_t move : game.moves)
+            {
+                if (g.hash() == key)
+                {
+                    next = to_san(g, move);
+                    break;
+                }
+                g.play(move);
+            }
+            printf("%8u  %-7s  %.*s - %.*s  %.*s  %zu plies\n", ids[i], next.c_str(),
+                   int(game.tag("White").size()), game.tag("White").data(),
+                   int(game.tag("Black").size()), game.tag("Black").data(),
+                   int(game.tag("Result").size()), game.tag("Result").data(), game.moves.size());
+        }
+        return 0;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "build") == 0)
+        return build(argc, argv);
+    if (argc >= 2 && strcmp(argv[1], "query") == 0)
+        return query(argc, argv);
+    return usage(argv[0]);
+}
@@ -0,0 +1,491 @@
+// Plays two engine configurations against each other and stops as soon as a
+// sequential probability ratio test decides between two Elo hypotheses.
+//
+//   match --engine depth=5 --engine nodes=20000,hash=32 [--games N] [--concurrency N]
+//         [--openings file.epd|file.pgn] [--plies N] [--random-plies N] [--seed N]
+//         [--sprt elo0 elo1] [--alpha A] [--beta B] [--max-plies N] [--pgn out.pgn]
+//
+// An engine is a comma separated list of name=, depth=, nodes=, time= (ms a
+// move), hash= (MB), book= and tablebases=. Both play in this process, so
+// builds are compared by changing the code and these settings, not by
+// loading another binary.
+//
+// Each opening is played twice with colours swapped. Openings are lines of
+// an EPD or FEN file, or the first --plies (default 8) of each game of a PGN
+// file, sampled at random; without a file --random-plies (default 8) random
+// moves are played from the start. Games run on --concurrency threads (one
+// per core by default), each pinned to a core on Linux. Every finished game
+// is appended to --pgn and the score, Elo, LOS and LLR are printed.
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include "book.hpp"
+#include "mapped_file.hpp"
+#include "pgn.hpp"
+#include "search.hpp"
+
+namespace
+{
+    int usage(const char *name)
+    {
+        fprintf(stderr, "usage: %s --engine depth=5 --engine nodes=20000,hash=32 [--games N] [--concurrency N]\n"
+                        "       [--openings file.epd|file.pgn] [--plies N] [--random-plies N] [--seed N]\n"
+                        "       [--sprt elo0 elo1] [--alpha A] [--beta B] [--max-plies N] [--pgn out.pgn]\n",
+                name);
+        return 1;
+    }
+
+    struct engine_config_t
+    {
+        std::string name;
+        search_limits_t limits;
+        size_t hash = 16;
+        std::shared_ptr<polyglot_book> book;
+        std::shared_ptr<tablebase_set> tablebases;
+    };
+
+    bool parse_engine(const char *text, engine_config_t &config)
+    {
+        config.limits.depth = 0;
+        std::string spec = text;
+        size_t start = 0;
+        while (start <= spec.size())
+        {
+            size_t end = spec.find(',', start);
+            if (end == std::string::npos)
+                end = spec.size();
+            std::string option = spec.substr(start, end - start);
+            start = end + 1;
+            size_t equals = option.find('=');
+            if (equals == std::string::npos)
+                return false;
+            std::string key = option.substr(0, equals), value = option.substr(equals + 1);
+            if (key == "name")
+                config.name = value;
+            else if (key == "depth")
+                config.limits.depth = std::min(atoi(value.c_str()), max_ply - 1);
+            else if (key == "nodes")
+                config.limits.nodes = strtoull(value.c_str(), nullptr, 10);
+            else if (key == "time")
+                config.limits.time = std::chrono::milliseconds(atoi(value.c_str()));
+            else if (key == "hash")
+                config.hash = size_t(atoi(value.c_str()));
+            else if (key == "book")
+            {
+                config.book = std::make_shared<polyglot_book>(value.c_str());
+                if (!config.book->is_open())
+                    return false;
+            }
+            else if (key == "tablebases")
+            {
+                config.tablebases = std::make_shared<tablebase_set>();
+                if (!config.tablebases->open_directory(value))
+                    return false;
+            }
+            else
+                return false;
+        }
+        // something has to end the search
+        if (!config.limits.depth && !config.limits.nodes && !config.limits.time.count())
+            config.limits.depth = 4;
+        else if (!config.limits.depth)
+            config.limits.depth = max_ply - 1;
+        if (config.name.empty())
+            config.name = text;
+        return true;
+    }
+
+    // positions games start from, as FEN
+    std::vector<std::string> load_openings(const char *path, size_t plies)
+    {
+        std::vector<std::string> openings;
+        mapped_file file(path, true);
+        if (!file.is_open())
+            return openings;
+        std::string_view text = file.text();
+        if (text.find('[') < text.find('\n'))
+        {
+            read_pgn(text, [&](const pgn_game_t &pgn)
+                     {
+                game_t game;
+                std::string_view fen = pgn.tag("FEN");
+                if (!fen.empty() && !game_t::from_fen(fen, game))
+                    return true;
+                size_t ply = 0;
+                for_each_san(pgn.movetext, [&](std::string_view san)
+                             {
+                    move_t move;
+                    if (ply == plies || !parse_san(game, san, move))
+                        return false;
+                    game.play(move);
+                    ply++;
+                    return true; });
+                openings.push_back(game.to_fen());
+                return true; });
+            return openings;
+        }
+        while (!text.empty())
+        {
+            size_t end = text.find('\n');
+            std::string_view line = text.substr(0, end);
+            text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+            game_t game;
+            std::string_view operations;
+            if (game_t::from_fen(line, game, &operations))
+                openings.push_back(game.to_fen());
+        }
+        return openings;
+    }
+
+    struct game_record_t
+    {
+        std::string white, black, fen, result, termination;
+        std::vector<std::string> san;
+    };
+
+    bool insufficient_material(const game_t &game)
+    {
+        uint64_t key = game.material;
+        for (bool white : {false, true})
+            if (material_count(key, white, piece_type::pawn) || material_count(key, white, piece_type::rook) ||
+                material_count(key, white, piece_type::queen) ||
+                material_count(key, white, piece_type::bishop) + material_count(key, white, piece_type::knight) > 1)
+                return false;
+        return true;
+    }
+
+    // one engine's state for the length of a game
+    struct player_t
+    {
+        explicit player_t(const engine_config_t &config) : config(config), tt(config.hash), searcher(tt)
+        {
+            searcher.tablebases = config.tablebases.get();
+        }
+        const engine_config_t &config;
+        transposition_table tt;
+        searcher_t searcher;
+    };
+
+    // plays from the FEN until the rules or max_plies end the game
+    game_record_t play_game(const engine_config_t &white, const engine_config_t &black, const std::string &fen,
+                            int max_plies, std::mt19937_64 &random)
+    {
+        game_record_t record;
+        record.white = white.name;
+        record.black = black.name;
+        record.fen = fen;
+        game_t game;
+        game_t::from_fen(fen, game);
+        player_t players[2] = {player_t(black), player_t(white)};
+        // positions since the last capture or pawn move, for repetitions
+        std::unordered_map<uint64_t, int> seen;
+        seen[game.hash()]++;
+
+        for (int ply = 0;; ply++)
+        {
+            std::vector<move_t> legal = game.legal_moves();
+            if (legal.empty())
+            {
+                bool mated = game.in_check(game.white_turn);
+                record.result = !mated ? "1/2-1/2" : game.white_turn ? "0-1"
+                                                                     : "1-0";
+                record.termination = mated ? "checkmate" : "stalemate";
+                return record;
+            }
+            if (game.halfmove_clock >= 100 || insufficient_material(game) || ply >= max_plies)
+            {
+                record.result = "1/2-1/2";
+                record.termination = game.halfmove_clock >= 100 ? "fifty moves" : ply >= max_plies ? "adjudicated"
+                                                                                                   : "insufficient material";
+                return record;
+            }
+
+            player_t &player = players[game.white_turn];
+            move_t move;
+            if (player.config.book)
+            {
+                move = player.config.book->pick(game, random());
+                if (std::find(legal.begin(), legal.end(), move) == legal.end())
+                    move = move_t();
+            }
+            if (move.isnull())
+            {
+                player.tt.new_search();
+                search_info_t info = player.searcher.search(game, player.config.limits);
+                move = info.pv.empty() ? legal.front() : info.pv.front();
+            }
+
+            record.san.push_back(to_san(game, move));
+            bool irreversible = game.is_capture(move) || game.get(move.from).ispawn();
+            game.play(move);
+            if (irreversible)
+                seen.clear();
+            if (++seen[game.hash()] >= 3)
+            {
+                record.result = "1/2-1/2";
+                record.termination = "repetition";
+                return record;
+            }
+        }
+    }
+
+    void write_pgn(FILE *out, const game_record_t &record, size_t round)
+    {
+        static const std::string start = game_t().to_fen();
+        fprintf(out, "[Event \"match\"]\n[Round \"%zu\"]\n[White \"%s\"]\n[Black \"%s\"]\n[Result \"%s\"]\n",
+                round, record.white.c_str(), record.black.c_str(), record.result.c_str());
+        if (record.fen != start)
+            fprintf(out, "[SetUp \"1\"]\n[FEN \"%s\"]\n", record.fen.c_str());
+        fprintf(out, "[Termination \"%s\"]\n[PlyCount \"%zu\"]\n\n", record.termination.c_str(), record.san.size());
+        game_t game;
+        game_t::from_fen(record.fen, game);
+        unsigned number = game.fullmove_number;
+        bool white = game.white_turn;
+        size_t column = 0;
+        auto word = [&](const std::string &text)
+        {
+            if (column && column + text.size() + 1 > 79)
+            {
+                fputc('\n', out);
+                column = 0;
+            }
+            else if (column)
+            {
+                fputc(' ', out);
+                column++;
+            }
+            fputs(text.c_str(), out);
+            column += text.size();
+        };
+        for (size_t i = 0; i < record.san.size(); i++)
+        {
+            if (white || i == 0)
+                word(std::to_string(number) + (white ? "." : "..."));
+            word(record.san[i]);
+            if (!white)
+                number++;
+            white = !white;
+        }
+        word(record.result);
+        fputs("\n\n", out);
+        fflush(out);
+    }
+
+    // wins, draws and losses of the first engine
+    struct score_t
+    {
+        uint64_t wins = 0, draws = 0, losses = 0;
+        uint64_t games() const { return wins + draws + losses; }
+        double score() const { return games() ? (wins + draws / 2.0) / games() : 0.5; }
+        // variance of one game's score
+        double variance() const
+        {
+            double s = score();
+            return games() ? (wins * (1 - s) * (1 - s) + draws * (0.5 - s) * (0.5 - s) + losses * s * s) / games() : 0;
+        }
+    };
+
+    double elo_to_score(double elo) { return 1 / (1 + std::pow(10.0, -elo / 400)); }
+    double score_to_elo(double score) { return -400 * std::log10(1 / score - 1); }
+
+    // log likelihood ratio of elo1 against elo0, with the game score taken as
+    // normally distributed around its mean
+    double llr(const score_t &s, double elo0, double elo1)
+    {
+        double variance = s.variance();
+        if (variance <= 0)
+            return 0;
+        double s0 = elo_to_score(elo0), s1 = elo_to_score(elo1);
+        return (s1 - s0) * (2 * s.score() - s0 - s1) * s.games() / (2 * variance);
+    }
+
+    void report(const score_t &s, double elo0, double elo1, double lower, double upper)
+    {
+        double score = std::min(std::max(s.score(), 1e-6), 1 - 1e-6);
+        double margin = 1.96 * std::sqrt(s.variance() / std::max<uint64_t>(s.games(), 1));
+        double low = std::max(score - margin, 1e-6), high = std::min(score + margin, 1 - 1e-6);
+        double decisive = double(s.wins + s.losses);
+        double los = decisive ? 0.5 * (1 + std::erf((double(s.wins) - double(s.losses)) / std::sqrt(2 * decisive))) : 0.5;
+        printf("games %llu  +%llu =%llu -%llu  score %.1f%%  elo %+.1f [%+.1f, %+.1f]  los %.1f%%  llr %.2f [%.2f, %.2f] (%g, %g)\n",
+               (unsigned long long)s.games(), (unsigned long long)s.wins, (unsigned long long)s.draws,
+               (unsigned long long)s.losses, 100 * s.score(), score_to_elo(score), score_to_elo(low),
+               score_to_elo(high), 100 * los, llr(s, elo0, elo1), lower, upper, elo0, elo1);
+        fflush(stdout);
+    }
+
+    void pin_to_core(unsigned core)
+    {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(core, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+        (void)core;
+#endif
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<engine_config_t> engines;
+    uint64_t games = 1000;
+    unsigned concurrency = std::max(1u, std::thread::hardware_concurrency());
+    const char *openings_path = nullptr, *pgn_path = nullptr;
+    size_t plies = 8, random_plies = 8;
+    uint64_t seed = 1;
+    double elo0 = 0, elo1 = 5, alpha = 0.05, beta = 0.05;
+    bool sprt = false;
+    int max_plies = 400;
+    for (int i = 1; i < argc; i++)
+    {
+        auto next = [&]
+        { return i + 1 < argc ? argv[++i] : nullptr; };
+        const char *arg = argv[i], *value = next();
+        if (!value)
+            return usage(argv[0]);
+        if (strcmp(arg, "--engine") == 0)
+        {
+            engines.emplace_back();
+            if (!parse_engine(value, engines.back()))
+            {
+                fprintf(stderr, "bad engine %s\n", value);
+                return 1;
+            }
+        }
+        else if (strcmp(arg, "--games") == 0)
+            games = strtoull(value, nullptr, 10);
+        else if (strcmp(arg, "--concurrency") == 0)
+            concurrency = std::max(1, atoi(value));
+        else if (strcmp(arg, "--openings") == 0)
+            openings_path = value;
+        else if (strcmp(arg, "--plies") == 0)
+            plies = size_t(atoi(value));
+        else if (strcmp(arg, "--random-plies") == 0)
+            random_plies = size_t(atoi(value));
+        else if (strcmp(arg, "--seed") == 0)
+            seed = strtoull(value, nullptr, 10);
+        else if (strcmp(arg, "--sprt") == 0 && i + 1 < argc)
+        {
+            sprt = true;
+            elo0 = atof(value);
+            elo1 = atof(argv[++i]);
+        }
+        else if (strcmp(arg, "--alpha") == 0)
+            alpha = atof(value);
+        else if (strcmp(arg, "--beta") == 0)
+            beta = atof(value);
+        else if (strcmp(arg, "--max-plies") == 0)
+            max_plies = atoi(value);
+        else if (strcmp(arg, "--pgn") == 0)
+            pgn_path = value;
+        else
+            return usage(argv[0]);
+    }
+    if (engines.size() != 2)
+        return usage(argv[0]);
+    if (engines[0].name == engines[1].name)
+    {
+        engines[0].name += " (1)";
+        engines[1].name += " (2)";
+    }
+
+    std::vector<std::string> openings;
+    if (openings_path)
+    {
+        openings = load_openings(openings_path, plies);
+        if (openings.empty())
+        {
+            fprintf(stderr, "no openings in %s\n", openings_path);
+            return 1;
+        }
+    }
+    FILE *pgn = pgn_path ? fopen(pgn_path, "a") : nullptr;
+    if (pgn_path && !pgn)
+    {
+        fprintf(stderr, "could not open %s\n", pgn_path);
+        return 1;
+    }
+
+    double lower = std::log(beta / (1 - alpha)), upper = std::log((1 - beta) / alpha);
+    printf("%s vs %s, %llu games on %u threads", engines[0].name.c_str(), engines[1].name.c_str(),
+           (unsigned long long)games, concurrency);
+    if (sprt)
+        printf(", sprt elo0 %g elo1 %g alpha %g beta %g", elo0, elo1, alpha, beta);
+    printf("\n");
+
+    std::mutex mutex;
+    std::atomic<uint64_t> next_game{0};
+    std::atomic<bool> done{false};
+    score_t score;
+    auto worker = [&](unsigned index)
+    {
+        pin_to_core(index % std::max(1u, std::thread::hardware_concurrency()));
+        uint64_t g;
+        while (!done && (g = next_game++) < games)
+        {
+            // both games of a pair start from the same opening
+            std::mt19937_64 random(seed + g / 2);
+            std::string fen;
+            if (!openings.empty())
+                fen = openings[random() % openings.size()];
+            else
+            {
+                game_t game;
+                for (size_t ply = 0; ply < random_plies; ply++)
+                {
+                    std::vector<move_t> moves = game.legal_moves();
+                    if (moves.empty())
+                        break;
+                    game.play(moves[random() % moves.size()]);
+                }
+                fen = game.to_fen();
+            }
+            bool first_white = g % 2 == 0;
+            const engine_config_t &white = engines[!first_white], &black = engines[first_white];
+            std::mt19937_64 book_random(seed ^ (g * 0x9e3779b97f4a7c15ull));
+            game_record_t record = play_game(white, black, fen, max_plies, book_random);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (done)
+                break;
+            bool white_won = record.result == "1-0", black_won = record.result == "0-1";
+            if (!white_won && !black_won)
+                score.draws++;
+            else if (white_won == first_white)
+                score.wins++;
+            else
+                score.losses++;
+            if (pgn)
+                write_pgn(pgn, record, size_t(g + 1));
+            report(score, elo0, elo1, lower, upper);
+            double ratio = llr(score, elo0, elo1);
+            if (sprt && (ratio <= lower || ratio >= upper))
+            {
+                printf("sprt: %s accepted\n", ratio >= upper ? "H1" : "H0");
+                done = true;
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < concurrency; i++)
+        threads.emplace_back(worker, i);
+    for (std::thread &t : threads)
+        t.join();
+    if (pgn)
+        fclose(pgn);
+    return 0;
+}
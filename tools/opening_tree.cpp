@@ -0,0 +1,186 @@
+// Builds opening statistics from PGN and looks positions up in them.
+//
+//   opening-tree build games.pgn tree.bin [--plies N] [--memory MB] [--book book.bin]
+//   opening-tree query tree.bin [fen]
+//
+// build replays every game with a result and counts white wins, draws and
+// black wins for each (position, move) in the first N plies (default 24),
+// sorting externally so memory stays within --memory (default 256 MB).
+// --book also writes a Polyglot book weighting moves by 2 * wins + draws for
+// the side playing them.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "book.hpp"
+#include "opening_tree.hpp"
+#include "pgn_import.hpp"
+
+namespace
+{
+    int usage(const char *name)
+    {
+        fprintf(stderr, "usage: %s build games.pgn tree.bin [--plies N] [--memory MB] [--book book.bin]\n"
+                        "       %s query tree.bin [fen]\n",
+                name, name);
+        return 1;
+    }
+
+    // 1, 0, -1 from white's point of view, 2 for anything else
+    int parse_result(std::string_view result)
+    {
+        if (result == "1-0")
+            return 1;
+        if (result == "0-1")
+            return -1;
+        if (result == "1/2-1/2")
+            return 0;
+        return 2;
+    }
+
+    bool write_book(const opening_tree &tree, const char *path)
+    {
+        FILE *out = fopen(path, "wb");
+        if (!out)
+            return false;
+        bool ok = true;
+        for (const tree_entry_t *first = tree.begin(); first != tree.end();)
+        {
+            const tree_entry_t *last = first;
+            uint64_t best = 0;
+            auto weight = [](const tree_entry_t &e)
+            { return 2 * uint64_t(e.white_turn ? e.white_wins : e.black_wins) + e.draws; };
+            for (; last != tree.end() && last->key == first->key; last++)
+                best = std::max(best, weight(*last));
+            // scaled down together so the best move still fits 16 bits
+            for (; first != last; first++)
+            {
+                book_entry_t entry;
+                entry.key = first->key;
+                entry.move = first->move;
+                entry.weight = uint16_t(best > 0xffff ? weight(*first) * 0xffff / best : weight(*first));
+                unsigned char bytes[16];
+                write_book_entry(entry, bytes);
+                ok = fwrite(bytes, sizeof(bytes), 1, out) == 1 && ok;
+            }
+        }
+        return fclose(out) == 0 && ok;
+    }
+
+    int build(int argc, char **argv)
+    {
+        if (argc < 4)
+            return usage(argv[0]);
+        size_t plies = 24, megabytes = 256;
+        const char *book_path = nullptr;
+        for (int i = 4; i + 1 < argc; i += 2)
+            if (strcmp(argv[i], "--plies") == 0)
+                plies = size_t(atoi(argv[i + 1]));
+            else if (strcmp(argv[i], "--memory") == 0)
+                megabytes = size_t(atoi(argv[i + 1]));
+            else if (strcmp(argv[i], "--book") == 0)
+                book_path = argv[i + 1];
+            else
+                return usage(argv[0]);
+
+        mapped_file file(argv[2], true);
+        if (!file.is_open())
+        {
+            fprintf(stderr, "could not open %s\n", argv[2]);
+            return 1;
+        }
+        auto start = std::chrono::steady_clock::now();
+        opening_tree_builder builder(argv[3], megabytes << 20);
+        size_t games = 0, skipped = 0, moves = 0;
+        bool ok = true;
+        pgn_import_options_t options;
+        options.book_plies = plies;
+        // the workers compute the keys and moves, the sink only stores them
+        import_pgn(file.text(), [&](const pgn_record_t &record)
+                   {
+            int result = parse_result(record.game.tag("Result"));
+            // a FEN that did not parse leaves no moves
+            if (result == 2 || (!record.game.tag("FEN").empty() && record.moves.empty() && !record.replayed))
+            {
+                skipped++;
+                return true;
+            }
+            games++;
+            for (size_t i = 0; i < record.book_keys.size() && ok; i++)
+            {
+                bool white_turn = (i % 2 == 0) == record.white_starts;
+                ok = builder.add(record.book_keys[i], record.book_moves[i], white_turn, result);
+                moves++;
+            }
+            return ok; }, options);
+        ok = ok && builder.finish();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (!ok)
+        {
+            fprintf(stderr, "could not write %s\n", argv[3]);
+            return 1;
+        }
+        printf("%zu games  %zu skipped  %zu moves  %llu entries  %zu runs  %.3f s  %.0f games/s\n",
+               games, skipped, moves, (unsigned long long)builder.entries_written(), builder.runs(),
+               seconds, games / seconds);
+
+        if (book_path && !write_book(opening_tree(argv[3]), book_path))
+        {
+            fprintf(stderr, "could not write %s\n", book_path);
+            return 1;
+        }
+        return 0;
+    }
+
+    int query(int argc, char **argv)
+    {
+        if (argc < 3)
+            return usage(argv[0]);
+        opening_tree tree(argv[2]);
+        if (!tree.is_open())
+        {
+            fprintf(stderr, "%s is not an opening tree\n", argv[2]);
+            return 1;
+        }
+        game_t game;
+        if (argc > 3 && !game_t::from_fen(argv[3], game))
+        {
+            fprintf(stderr, "bad FEN\n");
+            return 1;
+        }
+
+        uint64_t key = polyglot_key(game);
+        tree_entry_t entries[256];
+        // the lookup is repeated to time it
+        constexpr int lookups = 100000;
+        size_t found = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < lookups; i++)
+            found += tree.find(key, entries, 256);
+        double micros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / lookups;
+        size_t count = std::min<size_t>(found / lookups, 256);
+
+        printf("%zu entries, %zu moves, lookup %.3f us\n", tree.size(), count, micros);
+        std::sort(entries, entries + count, [](const tree_entry_t &a, const tree_entry_t &b)
+                  { return a.games() > b.games(); });
+        for (size_t i = 0; i < count; i++)
+        {
+            const tree_entry_t &e = entries[i];
+            move_t move = decode_book_move(game, e.move);
+            double games = double(e.games());
+            printf("%-8s %8llu  %5.1f%% %5.1f%% %5.1f%%\n", move.isnull() ? "?" : to_san(game, move).c_str(),
+                   (unsigned long long)e.games(), 100 * e.white_wins / games, 100 * e.draws / games,
+                   100 * e.black_wins / games);
+        }
+        return 0;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "build") == 0)
+        return build(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "query") == 0)
+        return query(argc, argv);
+    return usage(argv[0]);
+}
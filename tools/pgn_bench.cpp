@@ -0,0 +1,90 @@
+// Reads a PGN file through a memory mapping and reports how fast games are
+// split and tokenised, how fast their moves resolve and replay on one thread,
+// and how fast the parallel import does the same.
+//
+//   pgn-bench games.pgn [--no-replay] [--threads N]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "mapped_file.hpp"
+#include "pgn_import.hpp"
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s games.pgn [--no-replay] [--threads N]\n", argv[0]);
+        return 1;
+    }
+    bool replay = true;
+    pgn_import_options_t options;
+    for (int i = 2; i < argc; i++)
+        if (strcmp(argv[i], "--no-replay") == 0)
+            replay = false;
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            options.threads = unsigned(atoi(argv[++i]));
+    mapped_file file(argv[1], true);
+    if (!file.is_open())
+    {
+        fprintf(stderr, "could not open %s\n", argv[1]);
+        return 1;
+    }
+    double megabytes = file.length() / 1e6;
+
+    // splitting and tokenising only
+    size_t games = 0, tokens = 0;
+    auto start = std::chrono::steady_clock::now();
+    read_pgn(file.text(), [&](const pgn_game_t &game)
+             {
+        games++;
+        for_each_san(game.movetext, [&](std::string_view)
+                     { tokens++; return true; });
+        return true; });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("tokenise  %zu games  %zu moves  %.3f s  %.0f games/s  %.1f MB/s\n",
+           games, tokens, seconds, games / seconds, megabytes / seconds);
+    if (!replay)
+        return 0;
+
+    // resolving every SAN against the move generator and playing it
+    size_t replayed = 0, failed = 0, plies = 0;
+    game_t game;
+    start = std::chrono::steady_clock::now();
+    read_pgn(file.text(), [&](const pgn_game_t &pgn)
+             {
+        if (replay_pgn(pgn, game, [&](const game_t &, move_t)
+                       { plies++; }))
+            replayed++;
+        else if (++failed <= 10)
+        {
+            std::string_view event = pgn.tag("Event");
+            fprintf(stderr, "game %zu (%.*s) stops at move %u\n", replayed + failed,
+                    int(event.size()), event.data(), game.fullmove_number);
+        }
+        return true; });
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("replay    %zu games  %zu failed  %zu plies  %.3f s  %.0f games/s  %.0f plies/s  %.1f MB/s\n",
+           replayed, failed, plies, seconds, (replayed + failed) / seconds, plies / seconds, megabytes / seconds);
+
+    // the same work on the import pipeline, which must agree game for game
+    size_t imported = 0, import_failed = 0, import_plies = 0;
+    bool ordered = true;
+    start = std::chrono::steady_clock::now();
+    import_pgn(file.text(), [&](const pgn_record_t &record)
+               {
+        ordered = ordered && record.index == imported + import_failed;
+        (record.replayed ? imported : import_failed)++;
+        import_plies += record.moves.size();
+        return true; }, options);
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("import    %zu games  %zu failed  %zu plies  %.3f s  %.0f games/s  %.0f plies/s  %.1f MB/s\n",
+           imported, import_failed, import_plies, seconds, (imported + import_failed) / seconds,
+           import_plies / seconds, megabytes / seconds);
+    if (!ordered || imported != replayed || import_failed != failed || import_plies != plies)
+    {
+        fprintf(stderr, "import does not match the single threaded replay\n");
+        return 1;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,54 @@
+// Generates distance to mate tables by retrograde analysis, together with
+// every smaller table they lead to.
+//
+//   tb-gen [--threads N] [--dir path] KQvK KRvK KPvK ...
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include "tablebase.hpp"
+
+namespace
+{
+    void report(const tb_generate_stats_t &stats)
+    {
+        if (stats.existed)
+        {
+            printf("%-8s on disk\n", stats.name.c_str());
+            return;
+        }
+        printf("%-8s %11llu entries  %10llu wins  %10llu losses  %10llu draws  longest %3d plies  %3d passes  %.2f s\n",
+               stats.name.c_str(), (unsigned long long)stats.entries, (unsigned long long)stats.wins,
+               (unsigned long long)stats.losses, (unsigned long long)stats.draws, stats.longest, stats.passes,
+               stats.seconds);
+        fflush(stdout);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    std::string directory = ".";
+    tablebase_set tables;
+    int generated = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = unsigned(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc)
+            directory = argv[++i];
+        else if (!generate_tablebase(argv[i], directory, threads, tables, report))
+        {
+            fprintf(stderr, "could not generate %s\n", argv[i]);
+            return 1;
+        }
+        else
+            generated++;
+    }
+    if (!generated)
+    {
+        fprintf(stderr, "usage: %s [--threads N] [--dir path] KQvK KRvK KPvK ...\n", argv[0]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,141 @@
+#include "trace.hpp"
+
+#ifdef CHESS_TRACE
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+
+namespace
+{
+    // events are stored in chunks of 1.5 MB, up to 384 MB a thread
+    constexpr size_t chunk_events = 1 << 16;
+    constexpr size_t max_chunks = 256;
+
+    int64_t now_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Written only by its thread. count and next are published with release
+    // after what they cover, so trace_write can read up to them at any time.
+    // Buffers are never freed: a thread may end before the trace is written.
+    struct chunk_t
+    {
+        trace_event_t events[chunk_events];
+        std::atomic<size_t> count{0};
+        std::atomic<chunk_t *> next{nullptr};
+    };
+
+    struct thread_buffer_t
+    {
+        chunk_t first;
+        chunk_t *last = &first;
+        size_t chunks = 1;
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<const char *> name{nullptr};
+        unsigned id = 0;
+        thread_buffer_t *next = nullptr;
+    };
+
+    std::atomic<thread_buffer_t *> buffers{nullptr};
+    std::atomic<unsigned> thread_ids{0};
+    const int64_t epoch = now_ns();
+
+    thread_buffer_t &local_buffer()
+    {
+        thread_local thread_buffer_t *buffer = []
+        {
+            thread_buffer_t *b = new thread_buffer_t;
+            b->id = ++thread_ids;
+            b->next = buffers.load(std::memory_order_relaxed);
+            while (!buffers.compare_exchange_weak(b->next, b, std::memory_order_release, std::memory_order_relaxed))
+                ;
+            return b;
+        }();
+        return *buffer;
+    }
+
+    void write_string(FILE *out, const char *s)
+    {
+        fputc('"', out);
+        for (; *s; s++)
+        {
+            if (*s == '"' || *s == '\\')
+                fputc('\\', out);
+            fputc(*s, out);
+        }
+        fputc('"', out);
+    }
+}
+
+trace_scope_t::trace_scope_t(const char *name) : name(name), start(now_ns())
+{
+}
+
+trace_scope_t::~trace_scope_t()
+{
+    int64_t end = now_ns();
+    thread_buffer_t &buffer = local_buffer();
+    size_t i = buffer.last->count.load(std::memory_order_relaxed);
+    if (i == chunk_events)
+    {
+        if (buffer.chunks == max_chunks)
+        {
+            buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        chunk_t *chunk = new chunk_t;
+        buffer.last->next.store(chunk, std::memory_order_release);
+        buffer.last = chunk;
+        buffer.chunks++;
+        i = 0;
+    }
+    buffer.last->events[i] = {name, start, end - start};
+    buffer.last->count.store(i + 1, std::memory_order_release);
+}
+
+void trace_thread_name(const char *name)
+{
+    local_buffer().name.store(name, std::memory_order_relaxed);
+}
+
+bool trace_write(const char *path)
+{
+    FILE *out = fopen(path, "w");
+    if (!out)
+        return false;
+    fputs("{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n", out);
+    bool first = true;
+    uint64_t dropped = 0;
+    for (thread_buffer_t *b = buffers.load(std::memory_order_acquire); b; b = b->next)
+    {
+        const char *name = b->name.load(std::memory_order_relaxed);
+        if (name)
+        {
+            fprintf(out, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": ",
+                    first ? "" : ",\n", b->id);
+            write_string(out, name);
+            fputs("}}", out);
+            first = false;
+        }
+        for (const chunk_t *chunk = &b->first; chunk; chunk = chunk->next.load(std::memory_order_acquire))
+        {
+            size_t count = chunk->count.load(std::memory_order_acquire);
+            for (size_t i = 0; i < count; i++)
+            {
+                const trace_event_t &e = chunk->events[i];
+                fprintf(out, "%s{\"name\": ", first ? "" : ",\n");
+                write_string(out, e.name);
+                // microseconds with nanosecond decimals
+                fprintf(out, ", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}", b->id,
+                        (e.start_ns - epoch) / 1000.0, e.duration_ns / 1000.0);
+                first = false;
+            }
+        }
+        dropped += b->dropped.load(std::memory_order_relaxed);
+    }
+    fprintf(out, "\n], \"otherData\": {\"dropped_events\": %llu}}\n", (unsigned long long)dropped);
+    return fclose(out) == 0;
+}
+
+#endif
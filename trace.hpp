@@ -0,0 +1,56 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Scoped trace events written as Chrome trace-event JSON, which chrome://tracing
+// and Perfetto open. Everything here compiles to nothing unless CHESS_TRACE is
+// defined (cmake -DCHESS_TRACE=ON).
+//
+// Each thread records into its own buffer with no locking; the first event of
+// a thread links its buffer into a global list with a compare and swap.
+// Buffers grow in chunks up to a cap, events past it are counted and dropped.
+//
+//   CHESS_TRACE_SCOPE("evaluate");   // until the end of the enclosing block
+//   CHESS_TRACE_THREAD("engine");    // names the calling thread in the viewer
+
+#ifdef CHESS_TRACE
+
+struct trace_event_t
+{
+    // a string literal, only the pointer is kept
+    const char *name;
+    int64_t start_ns;
+    int64_t duration_ns;
+};
+
+class trace_scope_t
+{
+public:
+    explicit trace_scope_t(const char *name);
+    ~trace_scope_t();
+    trace_scope_t(const trace_scope_t &) = delete;
+    trace_scope_t &operator=(const trace_scope_t &) = delete;
+
+private:
+    const char *name;
+    int64_t start;
+};
+
+void trace_thread_name(const char *name);
+// writes every event recorded so far, threads may keep recording meanwhile.
+// Returns false if the file could not be written.
+bool trace_write(const char *path);
+
+#define CHESS_TRACE_CONCAT2(a, b) a##b
+#define CHESS_TRACE_CONCAT(a, b) CHESS_TRACE_CONCAT2(a, b)
+#define CHESS_TRACE_SCOPE(name) trace_scope_t CHESS_TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define CHESS_TRACE_THREAD(name) trace_thread_name(name)
+
+#else
+
+inline bool trace_write(const char *) { return false; }
+
+#define CHESS_TRACE_SCOPE(name) ((void)0)
+#define CHESS_TRACE_THREAD(name) ((void)0)
+
+#endif